@@ -20,19 +20,171 @@
 
 #include "membase.h"
 
+#ifdef __aarch64__
+#include <arm_neon.h>
+#include <arm_sve.h>
+#include <stdio.h>
+#else
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#endif
+
 #ifndef __clang__
 #error This file must be compiled with clang.
 #endif
 
 #define BASE_ALIGNMENT 16
 
-#define FEAT_AVX512 3
-#define FEAT_AVX2 2
-#define FEAT_SSE2 1
+/* a load whose address matches an older in-flight store in its low 12 bits is
+ * held back until the store resolves (4K aliasing), so copies where the loads
+ * run only a little ahead of the stores modulo a page stall on every vector */
+#define ALIAS_PAGE_SIZE 4096
+#define ALIAS_WINDOW 256
+#define ALIAS_MIN_SIZE 512
+
+#define CACHE_SIZE_FALLBACK (8 * 1024 * 1024)
+
+#ifdef __aarch64__
+/* the first line of one of cpu0's cache attributes in sysfs, 0 if it has none */
+static inline int read_cache_attribute(int index, const char *name, char *buf, int size)
+{
+    char path[80];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, name);
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    const int read = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return read;
+}
+
+/* size in bytes of the data/unified cache at the given level, or of the last level
+ * cache for level 0, from sysfs: the cache id registers can't be read from EL0 */
+static inline size_t cpu_cache_size(const int level)
+{
+    static size_t cache_sizes[4];
+    if (unlikely(!cache_sizes[0]))
+    {
+        char type[32], text[32];
+
+        for (int index = 0; read_cache_attribute(index, "type", type, sizeof(type)); index++)
+        {
+            unsigned int cache_level;
+            size_t size;
+            char unit = 'K';
+
+            if (type[0] == 'I') /* instruction caches */
+                continue;
+            if (!read_cache_attribute(index, "level", text, sizeof(text)) || sscanf(text, "%u", &cache_level) != 1 ||
+                cache_level < 1 || cache_level > 3)
+                continue;
+            if (!read_cache_attribute(index, "size", text, sizeof(text)) || sscanf(text, "%zu%c", &size, &unit) < 1)
+                continue;
+
+            cache_sizes[cache_level] = size << (unit == 'G' ? 30 : unit == 'M' ? 20 : unit == 'K' ? 10 : 0);
+            if (cache_sizes[cache_level] > cache_sizes[0])
+                cache_sizes[0] = cache_sizes[cache_level];
+        }
+
+        if (!cache_sizes[0])
+            cache_sizes[0] = CACHE_SIZE_FALLBACK;
+    }
+    const int index = level < 0 || level > 3 ? 0 : level;
+    return cache_sizes[index] ? cache_sizes[index] : cache_sizes[0];
+}
+
+#else
+/* size in bytes of the data/unified cache at the given level, or of the
+ * last level cache for level 0, from the deterministic cache parameters leaf */
+static inline size_t cpu_cache_size(const int level)
+{
+    static size_t cache_sizes[4];
+    if (unlikely(!cache_sizes[0]))
+    {
+        int regs[4];
+        unsigned int leaf = 4;
+
+        __cpuid(regs, 0);
+        if (regs[0] < 4)
+            leaf = 0;
+
+        /* AMD reports the same layout in an extended leaf instead */
+        __cpuidex(regs, leaf, 0);
+        if (!leaf || !(regs[0] & 0x1f))
+        {
+            __cpuid(regs, 0x80000000);
+            leaf = (unsigned int)regs[0] >= 0x8000001d ? 0x8000001d : 0;
+        }
+
+        for (int sub = 0; leaf && sub < 16; sub++)
+        {
+            __cpuidex(regs, leaf, sub);
+            const int type = regs[0] & 0x1f;
+            const int cache_level = (regs[0] >> 5) & 0x7;
+            if (!type)
+                break;
+            if (type == 2 || cache_level > 3) /* instruction caches */
+                continue;
+
+            const size_t ways = ((unsigned int)regs[1] >> 22) + 1;
+            const size_t partitions = (((unsigned int)regs[1] >> 12) & 0x3ff) + 1;
+            const size_t line_size = ((unsigned int)regs[1] & 0xfff) + 1;
+            const size_t sets = (unsigned int)regs[2] + 1;
+
+            cache_sizes[cache_level] = ways * partitions * line_size * sets;
+            if (cache_sizes[cache_level] > cache_sizes[0])
+                cache_sizes[0] = cache_sizes[cache_level];
+        }
+
+        if (!cache_sizes[0])
+            cache_sizes[0] = CACHE_SIZE_FALLBACK;
+    }
+    const int index = level < 0 || level > 3 ? 0 : level;
+    return cache_sizes[index] ? cache_sizes[index] : cache_sizes[0];
+}
+#endif
+
+/* past this size the destination would only evict the working set on its way out */
+#ifndef STREAMING_THRESHOLD
+#define STREAMING_THRESHOLD (cpu_cache_size(0) * 3 / 4)
+#endif
+
+/* how far ahead of the loads memcpy_hint's prefetchnta runs */
+#define PREFETCH_NTA_DISTANCE 512
+
+/* memcpy_prefault() has the kernel populate the destination a chunk at a time, right before
+ * copying into it, so the pages it just zeroed are still cached when the copy gets to them */
+#define PREFAULT_CHUNK (256 * 1024)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 /* Linux 5.14 */
+#endif
+
+/* memcpy_async() copies below this run inline when nothing is queued ahead of them,
+ * since handing them over would cost more than the copy */
+#define ASYNC_INLINE_MAX (64 * 1024)
+/* queued copies before memcpy_async() waits for a free slot; a power of two */
+#define ASYNC_RING_SIZE 256
+/* pause rounds the copy thread (and memcpy_wait()) spins before sleeping (or yielding) */
+#define ASYNC_SPIN 4096
+/* set in the queue's tail by memcpy_async_shutdown(): no ticket can be claimed after it */
+#define ASYNC_CLOSED (1ULL << 63)
+
+/* backward overlaps at least this far apart are split into disjoint chunks */
+#define MEMMOVE_SPLIT_MIN (8 * 1024)
 
 #define AVX512_VECTOR_BITS 9
 #define AVX2_VECTOR_BITS 8
 #define SSE2_VECTOR_BITS 7
+#define NEON_VECTOR_BITS 7
 
 #define MEMCPY_STEP_FWD(d, s, n, size)           \
     do                                           \
@@ -67,133 +219,2748 @@
             MEMCPY_STEP_BWD(d, s, n, size); \
     } while (0)
 
-#define IMPLEMENT_MEMOP(maybe_inlineable, suffix, vector_size)                                        \
-    NOBUILTIN [[gnu::aligned(vector_size)]]                                                           \
-    static maybe_inlineable void *memop_##suffix(void *dst, const void *src, size_t n, int direction) \
+/* loads count vectors into v[], lowest address first in either direction */
+#define LOAD_GROUP_DIR(v, s, count, size, direction)                  \
+    do                                                                \
+    {                                                                 \
+        if (unlikely(direction))                                      \
+            s -= (count) * (size);                                    \
+        for (int i_ = 0; i_ < (count); i_++)                          \
+            __builtin_memcpy_inline(&(v)[i_], s + i_ * (size), size); \
+        if (likely(!direction))                                       \
+            s += (count) * (size);                                    \
+    } while (0)
+
+#define STORE_GROUP_DIR(d, v, count, size, direction)                 \
+    do                                                                \
+    {                                                                 \
+        if (unlikely(direction))                                      \
+            d -= (count) * (size);                                    \
+        for (int i_ = 0; i_ < (count); i_++)                          \
+            __builtin_memcpy_inline(d + i_ * (size), &(v)[i_], size); \
+        if (likely(!direction))                                       \
+            d += (count) * (size);                                    \
+    } while (0)
+
+/* main loop schedules: a load and its store back to back, or all loads of an
+ * unrolled group into registers before any of its stores */
+#define SCHED_interleaved 0
+#define SCHED_grouped 1
+#define MEMOP_SCHED_ID(schedule) MEMOP_SCHED_ID_(schedule)
+#define MEMOP_SCHED_ID_(schedule) SCHED_##schedule
+
+/* the engine memcpy_local and memmove_local dispatch to; the rest of the grid
+ * is only reachable through memop_engines() */
+#ifndef MEMOP_UNROLL
+#ifdef MEMBASE_COMPACT
+#define MEMOP_UNROLL 2
+#else
+#define MEMOP_UNROLL 4
+#endif
+#endif
+#ifndef MEMOP_SCHEDULE
+#ifdef __aarch64__
+/* a group's loads all come before its stores, which is what lets them pair into ldp/stp */
+#define MEMOP_SCHEDULE grouped
+#else
+#define MEMOP_SCHEDULE interleaved
+#endif
+#endif
+
+#ifdef MEMBASE_COMPACT
+/* both ends of the bytes left loaded before either is stored, so that one copy of this
+ * does for every kernel, either direction and any overlap */
+#define MEMOP_TAIL_ENDS(d, s, n, size)                      \
+    do                                                      \
+    {                                                       \
+        char head_[size], tail_[size];                      \
+        __builtin_memcpy_inline(head_, s, size);            \
+        __builtin_memcpy_inline(tail_, s + n - size, size); \
+        __builtin_memcpy_inline(d, head_, size);            \
+        __builtin_memcpy_inline(d + n - size, tail_, size); \
+    } while (0)
+
+/* the compact build's one tail, out of line and shared by every kernel of every tier */
+NOBUILTIN NOINLINE
+static void memop_tail(char *d, const char *s, size_t n, int direction)
+{
+    if (direction)
+    {
+        d -= n;
+        s -= n;
+    }
+    if (n >= 32)
+        MEMOP_TAIL_ENDS(d, s, n, 32);
+    else if (n >= 16)
+        MEMOP_TAIL_ENDS(d, s, n, 16);
+    else if (n >= 8)
+        MEMOP_TAIL_ENDS(d, s, n, 8);
+    else if (n >= 4)
+        MEMOP_TAIL_ENDS(d, s, n, 4);
+    else if (n >= 2)
+        MEMOP_TAIL_ENDS(d, s, n, 2);
+    else if (n)
+        *d = *s;
+}
+
+#define MEMOP_TAIL_STEPS(d, s, n, direction) memop_tail(d, s, n, direction)
+#define MEMOP_TAIL_MASKED(d, s, n, direction) memop_tail(d, s, n, direction)
+#else
+/* the bytes left below a vector: descending power of two copies, or with AVX-512BW/VL
+ * one masked load and store (256-bit vectors only, so n fits the 32-bit mask) */
+#define MEMOP_TAIL_STEPS(d, s, n, direction) \
+    do                                       \
+    {                                        \
+        COPY_DIR(d, s, n, 32, direction);    \
+        COPY_DIR(d, s, n, 16, direction);    \
+        COPY_DIR(d, s, n, 8, direction);     \
+        COPY_DIR(d, s, n, 4, direction);     \
+        COPY_DIR(d, s, n, 2, direction);     \
+        COPY_DIR(d, s, n, 1, direction);     \
+    } while (0)
+
+#define MEMOP_TAIL_MASKED(d, s, n, direction)                               \
+    do                                                                      \
+    {                                                                       \
+        if (n)                                                              \
+        {                                                                   \
+            const __mmask32 k_ = (__mmask32)mask_below(n);                  \
+            if (unlikely(direction))                                        \
+            {                                                               \
+                d -= n;                                                     \
+                s -= n;                                                     \
+            }                                                               \
+            _mm256_mask_storeu_epi8(d, k_, _mm256_maskz_loadu_epi8(k_, s)); \
+        }                                                                   \
+    } while (0)
+#endif
+
+#define IMPLEMENT_MEMOP_VARIANT(maybe_inlineable, name, vector_size, unroll, schedule, tail) \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                  \
+    static maybe_inlineable void *name(void *dst, const void *src, size_t n, int direction)  \
+    {                                                                                        \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                    \
+        char *d = (char *)dst + (unlikely(direction) ? n : 0);                               \
+        const char *s = (const char *)src + (unlikely(direction) ? n : 0);                   \
+                                                                                             \
+        /* vector-sized copies in unrolled groups for better pipelining */                   \
+        while (n >= (unroll) * (vector_size))                                                \
+        {                                                                                    \
+            if (MEMOP_SCHED_ID(schedule) == SCHED_grouped)                                   \
+            {                                                                                \
+                vec_t v[unroll];                                                             \
+                LOAD_GROUP_DIR(v, s, unroll, vector_size, direction);                        \
+                STORE_GROUP_DIR(d, v, unroll, vector_size, direction);                       \
+                n -= (unroll) * (vector_size);                                               \
+            }                                                                                \
+            else                                                                             \
+            {                                                                                \
+                _Pragma("clang loop unroll(full)") for (int i = 0; i < (unroll); i++)        \
+                    COPY_DIR(d, s, n, vector_size, direction);                               \
+            }                                                                                \
+        }                                                                                    \
+                                                                                             \
+        /* remaining vectors */                                                              \
+        while (n >= vector_size)                                                             \
+        {                                                                                    \
+            COPY_DIR(d, s, n, vector_size, direction);                                       \
+        }                                                                                    \
+                                                                                             \
+        tail(d, s, n, direction);                                                            \
+                                                                                             \
+        return dst;                                                                          \
+    }
+
+#define MEMOP_STRINGIFY(x) MEMOP_STRINGIFY_(x)
+#define MEMOP_STRINGIFY_(x) #x
+
+#ifdef MEMBASE_COMPACT
+/* no grid in the compact build, only the engine the dispatchers use, under its grid name */
+#define IMPLEMENT_MEMOP_GRID(suffix, vector_size, tail)
+#define MEMOP_GRID_ENGINES(suffix, feature)                                                          \
+    {#suffix " x" MEMOP_STRINGIFY(MEMOP_UNROLL) " " MEMOP_STRINGIFY(MEMOP_SCHEDULE), memop_##suffix, \
+     feature, 1}
+#else
+#define IMPLEMENT_MEMOP_GRID(suffix, vector_size, tail)                                             \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x2_interleaved, vector_size, 2, interleaved, tail)   \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x4_interleaved, vector_size, 4, interleaved, tail)   \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x8_interleaved, vector_size, 8, interleaved, tail)   \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x16_interleaved, vector_size, 16, interleaved, tail) \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x2_grouped, vector_size, 2, grouped, tail)           \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x4_grouped, vector_size, 4, grouped, tail)           \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x8_grouped, vector_size, 8, grouped, tail)           \
+    IMPLEMENT_MEMOP_VARIANT(, memop_##suffix##_x16_grouped, vector_size, 16, grouped, tail)
+
+/* whether a grid entry is the same unroll and schedule as the dispatchers' engine */
+#define MEMOP_DISPATCHED(unroll, schedule) \
+    ((unroll) == MEMOP_UNROLL && SCHED_##schedule == MEMOP_SCHED_ID(MEMOP_SCHEDULE))
+
+#define MEMOP_GRID_ENGINES(suffix, feature)                                                                     \
+    {#suffix " x2 interleaved", memop_##suffix##_x2_interleaved, feature, MEMOP_DISPATCHED(2, interleaved)},    \
+    {#suffix " x4 interleaved", memop_##suffix##_x4_interleaved, feature, MEMOP_DISPATCHED(4, interleaved)},    \
+    {#suffix " x8 interleaved", memop_##suffix##_x8_interleaved, feature, MEMOP_DISPATCHED(8, interleaved)},    \
+    {#suffix " x16 interleaved", memop_##suffix##_x16_interleaved, feature, MEMOP_DISPATCHED(16, interleaved)}, \
+    {#suffix " x2 grouped", memop_##suffix##_x2_grouped, feature, MEMOP_DISPATCHED(2, grouped)},                \
+    {#suffix " x4 grouped", memop_##suffix##_x4_grouped, feature, MEMOP_DISPATCHED(4, grouped)},                \
+    {#suffix " x8 grouped", memop_##suffix##_x8_grouped, feature, MEMOP_DISPATCHED(8, grouped)},                \
+    {#suffix " x16 grouped", memop_##suffix##_x16_grouped, feature, MEMOP_DISPATCHED(16, grouped)}
+#endif
+
+/* orders non-temporal stores before anything that follows */
+#ifdef __aarch64__
+#define STREAM_FENCE() __asm__ __volatile__("dmb ish" : : : "memory")
+#else
+#define STREAM_FENCE() __asm__ __volatile__("sfence" : : : "memory")
+#endif
+
+/* row loops for 2D copies, prefetching the start of the next row while copying this one */
+#define COPY2D_ROWS(d, dpitch, s, spitch, height, copy_row) \
+    do                                                      \
+    {                                                       \
+        for (size_t row = 0; row < height; row++)           \
+        {                                                   \
+            __builtin_prefetch(s + spitch, 0);              \
+            __builtin_prefetch(d + dpitch, 1);              \
+            copy_row;                                       \
+            d += dpitch;                                    \
+            s += spitch;                                    \
+        }                                                   \
+    } while (0)
+
+/* rows of exactly size bytes */
+#define IMPLEMENT_COPY2D_FIXED(size)                                                                    \
+    NOBUILTIN                                                                                           \
+    static void copy2d_fixed_##size(char *d, size_t dpitch, const char *s, size_t spitch, size_t width, \
+                                    size_t height)                                                      \
+    {                                                                                                   \
+        (void)width;                                                                                    \
+        COPY2D_ROWS(d, dpitch, s, spitch, height, __builtin_memcpy_inline(d, s, size));                 \
+    }
+
+/* rows of more than size and less than 2 * size bytes, as two overlapping copies */
+#define IMPLEMENT_COPY2D_RANGE(size)                                                                    \
+    NOBUILTIN                                                                                           \
+    static void copy2d_range_##size(char *d, size_t dpitch, const char *s, size_t spitch, size_t width, \
+                                    size_t height)                                                      \
+    {                                                                                                   \
+        COPY2D_ROWS(d, dpitch, s, spitch, height,                                                       \
+                    __builtin_memcpy_inline(d, s, size);                                                \
+                    __builtin_memcpy_inline(d + width - size, s + width - size, size));                 \
+    }
+
+/* rows of any width through a tier's engines, optionally streaming with a single fence at the end */
+#define IMPLEMENT_COPY2D(suffix)                                                                    \
+    NOBUILTIN                                                                                       \
+    static void copy2d_##suffix(char *d, size_t dpitch, const char *s, size_t spitch, size_t width, \
+                                size_t height)                                                      \
+    {                                                                                               \
+        COPY2D_ROWS(d, dpitch, s, spitch, height, memop_##suffix(d, s, width, 0));                  \
+    }                                                                                               \
+                                                                                                    \
+    NOBUILTIN                                                                                       \
+    static void copy2d_##suffix##_stream(char *d, size_t dpitch, const char *s, size_t spitch,      \
+                                         size_t width, size_t height)                               \
+    {                                                                                               \
+        COPY2D_ROWS(d, dpitch, s, spitch, height, memop_##suffix##_nt(d, s, width));                \
+        STREAM_FENCE();                                                                             \
+    }
+
+/* indexed record copies prefetch the indexed side this many records ahead, and no more than
+ * the first GATHER_PREFETCH_SPAN bytes of each: the hardware prefetchers follow longer records */
+#define GATHER_PREFETCH_RECORDS 16
+#define GATHER_PREFETCH_SPAN 256
+
+/* the record sizes with a kernel of their own */
+#define GATHER_SIZES(X) X(8) X(16) X(24) X(32) X(48) X(64) X(128) X(256)
+
+/* every line of the size bytes at p, or of their start, rw as in __builtin_prefetch */
+#define PREFETCH_RECORD(p, size, rw)                                                         \
+    do                                                                                       \
+    {                                                                                        \
+        for (size_t k_ = 0; k_ < (size) && k_ < GATHER_PREFETCH_SPAN; k_ += CACHE_LINE_SIZE) \
+            __builtin_prefetch((p) + k_, rw);                                                \
+        if ((size) <= GATHER_PREFETCH_SPAN)                                                  \
+            __builtin_prefetch((p) + (size) - 1, rw);                                        \
+    } while (0)
+
+/* the records at base indexed by idx[i + GATHER_PREFETCH_RECORDS] and the lanes - 1 after
+ * it, as far as count goes */
+#define PREFETCH_AHEAD(base, idx, i, lanes, count, size, rw)                  \
+    do                                                                        \
+    {                                                                         \
+        const size_t ahead_ = (i) + GATHER_PREFETCH_RECORDS;                  \
+        for (size_t a_ = ahead_; a_ < ahead_ + (lanes) && a_ < (count); a_++) \
+            PREFETCH_RECORD((base) + (size_t)(idx)[a_] * (size), size, rw);   \
+    } while (0)
+
+/* gather_<name> copies src record idx[i] to dst record i, scatter_<name> src record i to dst
+ * record idx[i], each with copy_record from `from` to `to` */
+#define IMPLEMENT_GATHER_KERNELS(name, record_size, copy_record)                                      \
+    NOBUILTIN                                                                                         \
+    static void gather_##name(char *d, const char *s, const uint32_t *idx, size_t count, size_t size) \
     {                                                                                                 \
-        char *d = (char *)dst + (unlikely(direction) ? n : 0);                                        \
-        const char *s = (const char *)src + (unlikely(direction) ? n : 0);                            \
-                                                                                                      \
-        /* vector-sized copies in groups of 4 for better pipelining */                                \
-        while (n >= 4 * vector_size)                                                                  \
+        (void)size;                                                                                   \
+        for (size_t i = 0; i < count; i++)                                                            \
         {                                                                                             \
-            COPY_DIR(d, s, n, vector_size, direction);                                                \
-            COPY_DIR(d, s, n, vector_size, direction);                                                \
-            COPY_DIR(d, s, n, vector_size, direction);                                                \
-            COPY_DIR(d, s, n, vector_size, direction);                                                \
+            PREFETCH_AHEAD(s, idx, i, 1, count, record_size, 0);                                      \
+            char *to = d + i * (record_size);                                                         \
+            const char *from = s + (size_t)idx[i] * (record_size);                                    \
+            copy_record;                                                                              \
         }                                                                                             \
+    }                                                                                                 \
                                                                                                       \
-        /* remaining vectors */                                                                       \
-        while (n >= vector_size)                                                                      \
+    NOBUILTIN                                                                                         \
+    static void scatter_##name(char *d, const char *s, const uint32_t *idx, size_t count,             \
+                               size_t size)                                                           \
+    {                                                                                                 \
+        (void)size;                                                                                   \
+        for (size_t i = 0; i < count; i++)                                                            \
         {                                                                                             \
-            COPY_DIR(d, s, n, vector_size, direction);                                                \
+            PREFETCH_AHEAD(d, idx, i, 1, count, record_size, 1);                                      \
+            char *to = d + (size_t)idx[i] * (record_size);                                            \
+            const char *from = s + i * (record_size);                                                 \
+            copy_record;                                                                              \
         }                                                                                             \
-                                                                                                      \
-        /* remaining bytes */                                                                         \
-        COPY_DIR(d, s, n, 32, direction);                                                             \
-        COPY_DIR(d, s, n, 16, direction);                                                             \
-        COPY_DIR(d, s, n, 8, direction);                                                              \
-        COPY_DIR(d, s, n, 4, direction);                                                              \
-        COPY_DIR(d, s, n, 2, direction);                                                              \
-        COPY_DIR(d, s, n, 1, direction);                                                              \
-                                                                                                      \
-        return dst;                                                                                   \
     }
 
-#ifndef __AVX512F__
-#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
-#define has_avx512f cpu_supports(FEAT_AVX512)
-#define inlineable_avx512f
-#else
-#define has_avx512f 1
-#define inlineable_avx512f inline
-#endif
+/* records of exactly size bytes */
+#define IMPLEMENT_GATHER_FIXED(size) \
+    IMPLEMENT_GATHER_KERNELS(fixed_##size, size, __builtin_memcpy_inline(to, from, size))
 
-IMPLEMENT_MEMOP(inlineable_avx512f, avx512, 1ULL << (AVX512_VECTOR_BITS - 3))
+/* records of any size through a tier's engines */
+#define IMPLEMENT_GATHER(suffix) IMPLEMENT_GATHER_KERNELS(suffix, size, memop_##suffix(to, from, size, 0))
 
-#ifndef __AVX512F__
-#pragma clang attribute pop
+/* byte shuffle masks reversing each e-byte element of a 16/32/64 byte vector */
+#define BSWAP_IDX(j, e) ((j) / (e) * (e) + (e) - 1 - (j) % (e))
+#define BSWAP_MASK16(e, b)                                                                \
+    BSWAP_IDX(b + 0, e), BSWAP_IDX(b + 1, e), BSWAP_IDX(b + 2, e), BSWAP_IDX(b + 3, e),   \
+    BSWAP_IDX(b + 4, e), BSWAP_IDX(b + 5, e), BSWAP_IDX(b + 6, e), BSWAP_IDX(b + 7, e),   \
+    BSWAP_IDX(b + 8, e), BSWAP_IDX(b + 9, e), BSWAP_IDX(b + 10, e), BSWAP_IDX(b + 11, e), \
+    BSWAP_IDX(b + 12, e), BSWAP_IDX(b + 13, e), BSWAP_IDX(b + 14, e), BSWAP_IDX(b + 15, e)
+#define BSWAP_MASK_16B(e) BSWAP_MASK16(e, 0)
+#define BSWAP_MASK_32B(e) BSWAP_MASK16(e, 0), BSWAP_MASK16(e, 16)
+#define BSWAP_MASK_64B(e) BSWAP_MASK16(e, 0), BSWAP_MASK16(e, 16), BSWAP_MASK16(e, 32), BSWAP_MASK16(e, 48)
+
+/* whole elements one at a time, then whatever is left of a partial one as is */
+#define BSWAP_TAIL(d, s, n, bits)                                                  \
+    do                                                                             \
+    {                                                                              \
+        for (; n >= (bits) / 8; n -= (bits) / 8, d += (bits) / 8, s += (bits) / 8) \
+        {                                                                          \
+            uint##bits##_t x;                                                      \
+            __builtin_memcpy_inline(&x, s, (bits) / 8);                            \
+            x = __builtin_bswap##bits(x);                                          \
+            __builtin_memcpy_inline(d, &x, (bits) / 8);                            \
+        }                                                                          \
+        COPY_DIR(d, s, n, 4, 0);                                                   \
+        COPY_DIR(d, s, n, 2, 0);                                                   \
+        COPY_DIR(d, s, n, 1, 0);                                                   \
+    } while (0)
+
+#define IMPLEMENT_BSWAP_BITS(suffix, vector_size, mask, bits)                        \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                          \
+    static void *memcpy_bswap##bits##_##suffix(void *dst, const void *src, size_t n) \
+    {                                                                                \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));            \
+        char *d = (char *)dst;                                                       \
+        const char *s = (const char *)src;                                           \
+        const size_t elems = n & ~(size_t)((bits) / 8 - 1);                          \
+                                                                                     \
+        while (n >= 4 * (vector_size))                                               \
+        {                                                                            \
+            vec_t v[4];                                                              \
+            LOAD_GROUP_DIR(v, s, 4, vector_size, 0);                                 \
+            for (int i = 0; i < 4; i++)                                              \
+                v[i] = __builtin_shufflevector(v[i], v[i], mask((bits) / 8));        \
+            STORE_GROUP_DIR(d, v, 4, vector_size, 0);                                \
+            n -= 4 * (vector_size);                                                  \
+        }                                                                            \
+                                                                                     \
+        while (n >= vector_size)                                                     \
+        {                                                                            \
+            vec_t v;                                                                 \
+            __builtin_memcpy_inline(&v, s, vector_size);                             \
+            v = __builtin_shufflevector(v, v, mask((bits) / 8));                     \
+            __builtin_memcpy_inline(d, &v, vector_size);                             \
+            d += vector_size;                                                        \
+            s += vector_size;                                                        \
+            n -= vector_size;                                                        \
+        }                                                                            \
+                                                                                     \
+        /* the last vector's worth of whole elements again, overlapping what's done; \
+         * in place that would swap some of them back, so go one by one there */     \
+        if (elems >= (vector_size) && dst != src && n >= (bits) / 8)                 \
+        {                                                                            \
+            const size_t back = (vector_size) - (elems - ((char *)d - (char *)dst)); \
+            vec_t v;                                                                 \
+            __builtin_memcpy_inline(&v, s - back, vector_size);                      \
+            v = __builtin_shufflevector(v, v, mask((bits) / 8));                     \
+            __builtin_memcpy_inline(d - back, &v, vector_size);                      \
+            d += (vector_size) - back;                                               \
+            s += (vector_size) - back;                                               \
+            n -= (vector_size) - back;                                               \
+        }                                                                            \
+                                                                                     \
+        BSWAP_TAIL(d, s, n, bits);                                                   \
+        return dst;                                                                  \
+    }
+
+#define IMPLEMENT_BSWAP(suffix, vector_size, mask)      \
+    IMPLEMENT_BSWAP_BITS(suffix, vector_size, mask, 16) \
+    IMPLEMENT_BSWAP_BITS(suffix, vector_size, mask, 32) \
+    IMPLEMENT_BSWAP_BITS(suffix, vector_size, mask, 64)
+
+/* the scanners read whole aligned vectors, which may extend past either end of the
+ * buffer, but never into a page without a valid byte in it */
+#define NO_SANITIZE_OVERREAD __attribute__((no_sanitize("address")))
+
+#define movemask_sse2(v) ((uint64_t)(uint32_t)_mm_movemask_epi8((__m128i)(v)))
+#define movemask_avx2(v) ((uint64_t)(uint32_t)_mm256_movemask_epi8((__m256i)(v)))
+#define movemask_avx512(v) ((uint64_t)_mm512_movepi8_mask((__m512i)(v)))
+#define movemask_avx512vl(v) ((uint64_t)_mm256_movepi8_mask((__m256i)(v)))
+#define movemask_neon(v) neon_movemask((uint8x16_t)(v))
+
+#ifdef __aarch64__
+/* NEON has no movemask: each byte keeps the bit for its place in its half, then each half is summed */
+static FORCEINLINE uint64_t neon_movemask(uint8x16_t v)
+{
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t picked = vandq_u8(v, bits);
+    return vaddv_u8(vget_low_u8(picked)) | (uint64_t)vaddv_u8(vget_high_u8(picked)) << 8;
+}
 #endif
 
-#ifndef __AVX2__
-#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
-#define has_avx2 likely(cpu_supports(FEAT_AVX2))
-#define inlineable_avx2
+/* the low bits bits set, for bits up to and past 64 */
+static FORCEINLINE uint64_t mask_below(size_t bits)
+{
+    return bits < 64 ? (1ULL << bits) - 1 : ~0ULL;
+}
+
+#define IMPLEMENT_SCAN(suffix, vector_size)                                                                   \
+    typedef char scan_vec_##suffix##_t __attribute__((__vector_size__(vector_size)));                         \
+                                                                                                              \
+    /* bit i set if byte i of the aligned vector at p is c */                                                 \
+    static FORCEINLINE uint64_t scan_mask_##suffix(const char *p, scan_vec_##suffix##_t needle)               \
+    {                                                                                                         \
+        scan_vec_##suffix##_t v;                                                                              \
+        __builtin_memcpy_inline(&v, __builtin_assume_aligned(p, vector_size), vector_size);                   \
+        return movemask_##suffix(v == needle);                                                                \
+    }                                                                                                         \
+                                                                                                              \
+    /* first c in the n bytes from str; n is SIZE_MAX for strings, relying on the terminator */               \
+    NOBUILTIN NO_SANITIZE_OVERREAD                                                                            \
+    static const char *scan_fwd_##suffix(const char *str, size_t n, char c)                                   \
+    {                                                                                                         \
+        const scan_vec_##suffix##_t needle = (scan_vec_##suffix##_t){0} + c;                                  \
+        const char *p = (const char *)((uintptr_t)str & ~(uintptr_t)((vector_size) - 1));                     \
+        const size_t head = str - p;                                                                          \
+                                                                                                              \
+        uint64_t mask = (scan_mask_##suffix(p, needle) >> head) & mask_below(n);                              \
+        if (mask)                                                                                             \
+            return str + __builtin_ctzll(mask);                                                               \
+        if (n <= (vector_size) - head)                                                                        \
+            return NULL;                                                                                      \
+        n -= (vector_size) - head;                                                                            \
+        p += vector_size;                                                                                     \
+                                                                                                              \
+        /* single vectors up to a group boundary, so that groups never straddle a page either */              \
+        for (; (uintptr_t)p & (4 * (vector_size) - 1); p += vector_size, n -= vector_size)                    \
+        {                                                                                                     \
+            mask = scan_mask_##suffix(p, needle) & mask_below(n);                                             \
+            if (mask)                                                                                         \
+                return p + __builtin_ctzll(mask);                                                             \
+            if (n <= (vector_size))                                                                           \
+                return NULL;                                                                                  \
+        }                                                                                                     \
+                                                                                                              \
+        for (; n > 4 * (vector_size); p += 4 * (vector_size), n -= 4 * (vector_size))                         \
+        {                                                                                                     \
+            scan_vec_##suffix##_t v[4];                                                                       \
+            __builtin_memcpy_inline(v, __builtin_assume_aligned(p, 4 * (vector_size)), 4 * (vector_size));    \
+            if (movemask_##suffix((v[0] == needle) | (v[1] == needle) | (v[2] == needle) | (v[3] == needle))) \
+                break;                                                                                        \
+        }                                                                                                     \
+                                                                                                              \
+        /* the group with the match, or what's left of n */                                                   \
+        for (;; p += vector_size, n -= vector_size)                                                           \
+        {                                                                                                     \
+            mask = scan_mask_##suffix(p, needle) & mask_below(n);                                             \
+            if (mask)                                                                                         \
+                return p + __builtin_ctzll(mask);                                                             \
+            if (n <= (vector_size))                                                                           \
+                return NULL;                                                                                  \
+        }                                                                                                     \
+    }                                                                                                         \
+                                                                                                              \
+    /* last c in the n bytes from str */                                                                      \
+    NOBUILTIN NO_SANITIZE_OVERREAD                                                                            \
+    static const char *scan_bwd_##suffix(const char *str, size_t n, char c)                                   \
+    {                                                                                                         \
+        const scan_vec_##suffix##_t needle = (scan_vec_##suffix##_t){0} + c;                                  \
+        const char *p = (const char *)((uintptr_t)(str + n - 1) & ~(uintptr_t)((vector_size) - 1));           \
+        uint64_t mask = scan_mask_##suffix(p, needle) & mask_below(str + n - p);                              \
+                                                                                                              \
+        while (p > str + 4 * (vector_size) && !mask)                                                          \
+        {                                                                                                     \
+            scan_vec_##suffix##_t v[4];                                                                       \
+            __builtin_memcpy_inline(v, __builtin_assume_aligned(p - 4 * (vector_size), vector_size),          \
+                                    4 * (vector_size));                                                       \
+            if (movemask_##suffix((v[0] == needle) | (v[1] == needle) | (v[2] == needle) | (v[3] == needle))) \
+                break;                                                                                        \
+            p -= 4 * (vector_size);                                                                           \
+        }                                                                                                     \
+                                                                                                              \
+        /* the group with the match, or the last few vectors down to str */                                   \
+        for (;;)                                                                                              \
+        {                                                                                                     \
+            if (p < str)                                                                                      \
+                mask &= ~mask_below(str - p);                                                                 \
+            if (mask)                                                                                         \
+                return p + 63 - __builtin_clzll(mask);                                                        \
+            if (p <= str)                                                                                     \
+                return NULL;                                                                                  \
+            p -= vector_size;                                                                                 \
+            mask = scan_mask_##suffix(p, needle);                                                             \
+        }                                                                                                     \
+    }
+
+/* n bytes of c with a few overlapping word stores, for fills shorter than a vector */
+static FORCEINLINE void fill_scalar(char *d, size_t n, char c)
+{
+    const uint64_t x = 0x0101010101010101ULL * (unsigned char)c;
+    const uint32_t y = (uint32_t)x;
+    const uint16_t z = (uint16_t)x;
+
+    if (n >= 8)
+    {
+        for (; n > 8; n -= 8, d += 8)
+            __builtin_memcpy_inline(d, &x, 8);
+        __builtin_memcpy_inline(d + n - 8, &x, 8);
+    }
+    else if (n >= 4)
+    {
+        __builtin_memcpy_inline(d, &y, 4);
+        __builtin_memcpy_inline(d + n - 4, &y, 4);
+    }
+    else if (n >= 2)
+    {
+        __builtin_memcpy_inline(d, &z, 2);
+        __builtin_memcpy_inline(d + n - 2, &z, 2);
+    }
+    else if (n)
+        *d = c;
+}
+
+#ifdef __aarch64__
+/* zero fills this long go by whole DC ZVA blocks, which zero their lines in the cache
+ * without reading them in first */
+#define ZVA_MIN_SIZE 512
+
+/* the block DC ZVA zeroes, from DCZID_EL0; 0 where it is prohibited (or smaller than a vector) */
+static size_t zva_block_size(void)
+{
+    static size_t block = 1;
+    if (unlikely(block == 1))
+    {
+        uint64_t dczid;
+        __asm__("mrs %0, dczid_el0" : "=r"(dczid));
+        block = (dczid & 16) || (dczid & 15) < 2 ? 0 : 4ULL << (dczid & 15);
+    }
+    return block;
+}
+
+/* zeroes vectors from d up to a block boundary, then whole blocks below end; returns where the
+ * blocks stopped, or d when there isn't a whole one */
+NOBUILTIN
+static char *zero_blocks(char *d, const char *end)
+{
+    const size_t block = zva_block_size();
+    char *p = (char *)(((uintptr_t)d + block - 1) & ~(uintptr_t)(block - 1));
+    const uint64_t zero[2] = {0};
+
+    if (!block || p + block > end)
+        return d;
+    for (; d < p; d += 16)
+        __builtin_memcpy_inline(d, zero, 16);
+    for (; p + block <= end; p += block)
+        __asm__ __volatile__("dc zva, %0" : : "r"(p) : "memory");
+    return p;
+}
+
+/* where a fill of n bytes of c from d goes on with vectors, past whatever went some other way */
+#define FILL_BLOCKS(d, n, c) (!(c) && (n) >= ZVA_MIN_SIZE ? zero_blocks(d, (d) + (n)) : (d))
 #else
-#define has_avx2 1
-#define inlineable_avx2 inline
+#define FILL_BLOCKS(d, n, c) (d)
 #endif
 
-IMPLEMENT_MEMOP(inlineable_avx2, avx2, 1ULL << (AVX2_VECTOR_BITS - 3))
+#define IMPLEMENT_PAD(suffix, vector_size)                                                      \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                     \
+    static void fill_##suffix(char *d, size_t n, char c)                                        \
+    {                                                                                           \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                       \
+        const vec_t f = (vec_t){0} + c;                                                         \
+                                                                                                \
+        if (n < (vector_size))                                                                  \
+        {                                                                                       \
+            fill_scalar(d, n, c);                                                               \
+            return;                                                                             \
+        }                                                                                       \
+                                                                                                \
+        char *const last = d + n - (vector_size);                                               \
+        d = FILL_BLOCKS(d, n, c);                                                               \
+        for (; d + 4 * (vector_size) <= last; d += 4 * (vector_size))                           \
+        {                                                                                       \
+            for (int i = 0; i < 4; i++)                                                         \
+                __builtin_memcpy_inline(d + i * (vector_size), &f, vector_size);                \
+        }                                                                                       \
+        for (; d < last; d += vector_size)                                                      \
+            __builtin_memcpy_inline(d, &f, vector_size);                                        \
+        __builtin_memcpy_inline(last, &f, vector_size);                                         \
+    }                                                                                           \
+                                                                                                \
+    /* whole vectors of the copy, then the fill, then the copy's partial vector as the          \
+     * last vector of src, which also repairs whatever a fill vector overlapping                \
+     * backwards put there; no store smaller than a vector unless total is */                   \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                     \
+    static void pad_##suffix(char *d, const char *s, size_t n, size_t total, char c)            \
+    {                                                                                           \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                       \
+        const vec_t f = (vec_t){0} + c;                                                         \
+        const size_t whole = n & ~(size_t)((vector_size) - 1);                                  \
+                                                                                                \
+        if (total < (vector_size))                                                              \
+        {                                                                                       \
+            memop_##suffix(d, s, n, 0);                                                         \
+            fill_scalar(d + n, total - n, c);                                                   \
+            return;                                                                             \
+        }                                                                                       \
+                                                                                                \
+        memop_##suffix(d, s, whole, 0);                                                         \
+        d += whole;                                                                             \
+        s += whole;                                                                             \
+        n -= whole;                                                                             \
+        total -= whole;                                                                         \
+                                                                                                \
+        if (total - n >= (vector_size))                                                         \
+            fill_##suffix(d + n, total - n, c);                                                 \
+        else                                                                                    \
+            __builtin_memcpy_inline(d + total - (vector_size), &f, vector_size);                \
+                                                                                                \
+        if (whole)                                                                              \
+            __builtin_memcpy_inline(d + n - (vector_size), s + n - (vector_size), vector_size); \
+        else                                                                                    \
+            memop_##suffix(d, s, n, 0);                                                         \
+    }
 
-#ifndef __AVX2__
-#pragma clang attribute pop
-#endif
+/* copies src through its terminator, but no more than n bytes, scanning aligned vectors
+ * as scan_fwd does and storing each one once it is known to lie inside the string */
+#define IMPLEMENT_STRCOPY(suffix, vector_size)                                                              \
+    /* the copy's first and last vectors, overlapping the aligned ones stored so far;                       \
+     * p and mask are the vector holding the terminator, or no mask when n ran out */                       \
+    static FORCEINLINE char *strcopy_end_##suffix(char *dst, const char *src, const char *p, uint64_t mask, \
+                                                  size_t n)                                                 \
+    {                                                                                                       \
+        const size_t len = mask ? (size_t)(p - src) + __builtin_ctzll(mask) + 1 : n;                        \
+                                                                                                            \
+        if (len < (vector_size))                                                                            \
+            memop_##suffix(dst, src, len, 0);                                                               \
+        else                                                                                                \
+        {                                                                                                   \
+            __builtin_memcpy_inline(dst, src, vector_size);                                                 \
+            __builtin_memcpy_inline(dst + len - (vector_size), src + len - (vector_size), vector_size);     \
+        }                                                                                                   \
+        return mask ? dst + len - 1 : NULL;                                                                 \
+    }                                                                                                       \
+                                                                                                            \
+    /* dst's terminator, or NULL if src had none in its first n bytes (all of which were copied) */         \
+    NOBUILTIN NO_SANITIZE_OVERREAD                                                                          \
+    static char *strcopy_##suffix(char *dst, const char *src, size_t n)                                     \
+    {                                                                                                       \
+        const scan_vec_##suffix##_t zero = {0};                                                             \
+        const char *p = (const char *)((uintptr_t)src & ~(uintptr_t)((vector_size) - 1));                   \
+        const size_t head = src - p;                                                                        \
+                                                                                                            \
+        uint64_t mask = (scan_mask_##suffix(p, zero) >> head) & mask_below(n);                              \
+        if (mask || n <= (vector_size) - head)                                                              \
+            return strcopy_end_##suffix(dst, src, src, mask, n);                                            \
+        p += vector_size;                                                                                   \
+                                                                                                            \
+        for (; (uintptr_t)p & (4 * (vector_size) - 1); p += vector_size)                                    \
+        {                                                                                                   \
+            const size_t left = n - (p - src);                                                              \
+            scan_vec_##suffix##_t v;                                                                        \
+            __builtin_memcpy_inline(&v, __builtin_assume_aligned(p, vector_size), vector_size);             \
+            mask = movemask_##suffix(v == zero) & mask_below(left);                                         \
+            if (mask || left <= (vector_size))                                                              \
+                return strcopy_end_##suffix(dst, src, p, mask, n);                                          \
+            __builtin_memcpy_inline(dst + (p - src), &v, vector_size);                                      \
+        }                                                                                                   \
+                                                                                                            \
+        for (; n - (p - src) > 4 * (vector_size); p += 4 * (vector_size))                                   \
+        {                                                                                                   \
+            /* named rather than an array, which some compilers keep on the stack across the break */       \
+            const char *q = __builtin_assume_aligned(p, 4 * (vector_size));                                 \
+            scan_vec_##suffix##_t v0, v1, v2, v3;                                                           \
+            __builtin_memcpy_inline(&v0, q, vector_size);                                                   \
+            __builtin_memcpy_inline(&v1, q + (vector_size), vector_size);                                   \
+            __builtin_memcpy_inline(&v2, q + 2 * (vector_size), vector_size);                               \
+            __builtin_memcpy_inline(&v3, q + 3 * (vector_size), vector_size);                               \
+            if (movemask_##suffix((v0 == zero) | (v1 == zero) | (v2 == zero) | (v3 == zero)))               \
+                break;                                                                                      \
+            __builtin_memcpy_inline(dst + (p - src), &v0, vector_size);                                     \
+            __builtin_memcpy_inline(dst + (p - src) + (vector_size), &v1, vector_size);                     \
+            __builtin_memcpy_inline(dst + (p - src) + 2 * (vector_size), &v2, vector_size);                 \
+            __builtin_memcpy_inline(dst + (p - src) + 3 * (vector_size), &v3, vector_size);                 \
+        }                                                                                                   \
+                                                                                                            \
+        /* the group with the terminator, or what's left of n */                                            \
+        for (;; p += vector_size)                                                                           \
+        {                                                                                                   \
+            const size_t left = n - (p - src);                                                              \
+            scan_vec_##suffix##_t v;                                                                        \
+            __builtin_memcpy_inline(&v, __builtin_assume_aligned(p, vector_size), vector_size);             \
+            mask = movemask_##suffix(v == zero) & mask_below(left);                                         \
+            if (mask || left <= (vector_size))                                                              \
+                return strcopy_end_##suffix(dst, src, p, mask, n);                                          \
+            __builtin_memcpy_inline(dst + (p - src), &v, vector_size);                                      \
+        }                                                                                                   \
+    }
 
-#ifndef __SSE2__
-#pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
-#define has_sse2 likely(cpu_supports(FEAT_SSE2))
-#define inlineable_sse2
+/* forward copy that prefetches the source with prefetchnta, so it passes through without
+ * displacing anything in the outer caches; stores are cached, or non-temporal with stream */
+#define IMPLEMENT_MEMOP_NTA(suffix, vector_size)                                        \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                             \
+    static void *memop_##suffix##_nta(void *dst, const void *src, size_t n, int stream) \
+    {                                                                                   \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));               \
+        char *d = (char *)dst;                                                          \
+        const char *s = (const char *)src;                                              \
+                                                                                        \
+        if (stream)                                                                     \
+        {                                                                               \
+            const size_t head = -(uintptr_t)d & ((vector_size) - 1);                    \
+            if (n < head + 4 * (vector_size))                                           \
+                return memop_##suffix(dst, src, n, 0);                                  \
+            memop_##suffix(d, s, head, 0);                                              \
+            d += head;                                                                  \
+            s += head;                                                                  \
+            n -= head;                                                                  \
+        }                                                                               \
+                                                                                        \
+        while (n >= 4 * (vector_size))                                                  \
+        {                                                                               \
+            for (size_t k = 0; k < 4 * (vector_size); k += 64)                          \
+                __builtin_prefetch(s + PREFETCH_NTA_DISTANCE + k, 0, 0);                \
+                                                                                        \
+            vec_t v[4];                                                                 \
+            LOAD_GROUP_DIR(v, s, 4, vector_size, 0);                                    \
+            if (stream)                                                                 \
+            {                                                                           \
+                for (int i = 0; i < 4; i++)                                             \
+                    __builtin_nontemporal_store(v[i], (vec_t *)d + i);                  \
+                d += 4 * (vector_size);                                                 \
+            }                                                                           \
+            else                                                                        \
+                STORE_GROUP_DIR(d, v, 4, vector_size, 0);                               \
+            n -= 4 * (vector_size);                                                     \
+        }                                                                               \
+                                                                                        \
+        memop_##suffix(d, s, n, 0);                                                     \
+        if (stream)                                                                     \
+            STREAM_FENCE();                                                             \
+        return dst;                                                                     \
+    }
+
+/* whole lines from a line aligned d with non-temporal stores, which need no write back */
+#define IMPLEMENT_PERSIST(suffix, vector_size)                                   \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                      \
+    static void persist_lines_##suffix(char *d, const char *s, size_t lines)     \
+    {                                                                            \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));        \
+                                                                                 \
+        for (; lines; lines--, d += CACHE_LINE_SIZE, s += CACHE_LINE_SIZE)       \
+        {                                                                        \
+            for (int i = 0; i < CACHE_LINE_SIZE / (int)(vector_size); i++)       \
+            {                                                                    \
+                vec_t v;                                                         \
+                __builtin_memcpy_inline(&v, s + i * (vector_size), vector_size); \
+                __builtin_nontemporal_store(v, (vec_t *)d + i);                  \
+            }                                                                    \
+        }                                                                        \
+    }
+
+/* byte by byte, storing only the bytes that differ; for the partial lines at either end of a delta copy */
+static FORCEINLINE size_t delta_bytes(char *d, const char *s, size_t n)
+{
+    size_t changed = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (d[i] != s[i])
+        {
+            d[i] = s[i];
+            changed++;
+        }
+    }
+    return changed;
+}
+
+/* marks line of a memcpy_delta() bitmap as stored if anything in it changed */
+static FORCEINLINE size_t delta_mark(uint64_t *dirty_lines, size_t line, size_t changed)
+{
+    if (dirty_lines && changed)
+        dirty_lines[line / 64] |= 1ULL << (line & 63);
+    return changed;
+}
+
+/* whole lines from a line aligned d, each compared a vector at a time and stored only if
+ * anything in it differs, so that unchanged lines stay clean; returns the bytes that differed,
+ * and marks the stored lines from line on in dirty_lines */
+#define IMPLEMENT_DELTA(suffix, vector_size)                                                                \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                                 \
+    static size_t delta_lines_##suffix(char *d, const char *s, size_t lines, uint64_t *dirty_lines,         \
+                                       size_t line)                                                         \
+    {                                                                                                       \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                                   \
+        size_t changed = 0;                                                                                 \
+                                                                                                            \
+        for (; lines; lines--, line++, d += CACHE_LINE_SIZE, s += CACHE_LINE_SIZE)                          \
+        {                                                                                                   \
+            vec_t v[CACHE_LINE_SIZE / (vector_size)];                                                       \
+            uint64_t diff[CACHE_LINE_SIZE / (vector_size)], any = 0;                                        \
+            for (int i = 0; i < CACHE_LINE_SIZE / (int)(vector_size); i++)                                  \
+            {                                                                                               \
+                vec_t old;                                                                                  \
+                __builtin_memcpy_inline(&v[i], s + i * (vector_size), vector_size);                         \
+                __builtin_memcpy_inline(&old, __builtin_assume_aligned(d + i * (vector_size), vector_size), \
+                                        vector_size);                                                       \
+                diff[i] = movemask_##suffix(v[i] != old);                                                   \
+                any |= diff[i];                                                                             \
+            }                                                                                               \
+            if (!any)                                                                                       \
+                continue;                                                                                   \
+                                                                                                            \
+            delta_mark(dirty_lines, line, 1);                                                               \
+            for (int i = 0; i < CACHE_LINE_SIZE / (int)(vector_size); i++)                                  \
+            {                                                                                               \
+                __builtin_memcpy_inline(d + i * (vector_size), &v[i], vector_size);                         \
+                changed += __builtin_popcountll(diff[i]);                                                   \
+            }                                                                                               \
+        }                                                                                                   \
+        return changed;                                                                                     \
+    }
+
+/* n bytes exchanged between a and b a word, then a byte at a time; for what the vectors leave */
+static FORCEINLINE void swap_bytes(char *a, char *b, size_t n)
+{
+    uint64_t wa, wb;
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+    {
+        __builtin_memcpy_inline(&wa, a, 8);
+        __builtin_memcpy_inline(&wb, b, 8);
+        __builtin_memcpy_inline(a, &wb, 8);
+        __builtin_memcpy_inline(b, &wa, 8);
+    }
+    for (; n; n--, a++, b++)
+    {
+        const char c = *a;
+        *a = *b;
+        *b = c;
+    }
+}
+
+/* n bytes exchanged between a and b, which must not overlap: four vectors of each side are
+ * loaded before any is stored, so the registers are the only scratch space. The tail can't
+ * overlap backwards as the copies do, since that would swap some bytes twice */
+#define IMPLEMENT_SWAP(suffix, vector_size)                                                    \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                    \
+    static void swap_##suffix(char *a, char *b, size_t n)                                      \
+    {                                                                                          \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                      \
+        vec_t va[4], vb[4];                                                                    \
+                                                                                               \
+        for (; n >= 4 * (vector_size); n -= 4 * (vector_size))                                 \
+        {                                                                                      \
+            for (int i = 0; i < 4; i++)                                                        \
+            {                                                                                  \
+                __builtin_memcpy_inline(&va[i], a + i * (vector_size), vector_size);           \
+                __builtin_memcpy_inline(&vb[i], b + i * (vector_size), vector_size);           \
+            }                                                                                  \
+            for (int i = 0; i < 4; i++)                                                        \
+            {                                                                                  \
+                __builtin_memcpy_inline(a + i * (vector_size), &vb[i], vector_size);           \
+                __builtin_memcpy_inline(b + i * (vector_size), &va[i], vector_size);           \
+            }                                                                                  \
+            a += 4 * (vector_size);                                                            \
+            b += 4 * (vector_size);                                                            \
+        }                                                                                      \
+        for (; n >= (vector_size); n -= (vector_size), a += (vector_size), b += (vector_size)) \
+        {                                                                                      \
+            __builtin_memcpy_inline(&va[0], a, vector_size);                                   \
+            __builtin_memcpy_inline(&vb[0], b, vector_size);                                   \
+            __builtin_memcpy_inline(a, &vb[0], vector_size);                                   \
+            __builtin_memcpy_inline(b, &va[0], vector_size);                                   \
+        }                                                                                      \
+        swap_bytes(a, b, n);                                                                   \
+    }
+
+/* whether all n bytes at s are zero, a word at a time */
+static FORCEINLINE int zero_bytes(const char *s, size_t n)
+{
+    uint64_t w;
+    for (; n >= 8; n -= 8, s += 8)
+    {
+        __builtin_memcpy_inline(&w, s, 8);
+        if (w)
+            return 0;
+    }
+    for (; n; n--, s++)
+    {
+        if (*s)
+            return 0;
+    }
+    return 1;
+}
+
+/* whether all n bytes at s are zero, ORing four vectors together at a time and stopping at
+ * the first group that isn't; the last vector overlaps backwards */
+#define IMPLEMENT_ZERO(suffix, vector_size)                                         \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                         \
+    static int all_zero_##suffix(const char *s, size_t n)                           \
+    {                                                                               \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));           \
+        const vec_t zero = {0};                                                     \
+        vec_t v[4];                                                                 \
+                                                                                    \
+        if (n < (vector_size))                                                      \
+            return zero_bytes(s, n);                                                \
+                                                                                    \
+        const char *const last = s + n - (vector_size);                             \
+        for (; s + 4 * (vector_size) <= last; s += 4 * (vector_size))               \
+        {                                                                           \
+            for (int i = 0; i < 4; i++)                                             \
+                __builtin_memcpy_inline(&v[i], s + i * (vector_size), vector_size); \
+            if (movemask_##suffix(((v[0] | v[1]) | (v[2] | v[3])) != zero))         \
+                return 0;                                                           \
+        }                                                                           \
+        for (; s < last; s += vector_size)                                          \
+        {                                                                           \
+            __builtin_memcpy_inline(&v[0], s, vector_size);                         \
+            if (movemask_##suffix(v[0] != zero))                                    \
+                return 0;                                                           \
+        }                                                                           \
+        __builtin_memcpy_inline(&v[0], last, vector_size);                          \
+        return !movemask_##suffix(v[0] != zero);                                    \
+    }
+
+#define IMPLEMENT_MEMOP(maybe_inlineable, suffix, vector_size, tail)                            \
+    IMPLEMENT_MEMOP_VARIANT(maybe_inlineable, memop_##suffix, vector_size, MEMOP_UNROLL,        \
+                            MEMOP_SCHEDULE, tail)                                               \
+    IMPLEMENT_MEMOP_GRID(suffix, vector_size, tail)                                             \
+                                                                                                \
+    /* same copy, but each unrolled group is loaded before the previous group is stored,        \
+     * so no load ever has to look past a store it could falsely alias */                       \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                     \
+    static maybe_inlineable void *memop_##suffix##_ahead(void *dst, const void *src, size_t n,  \
+                                                         int direction)                         \
+    {                                                                                           \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                       \
+        char *d = (char *)dst + (unlikely(direction) ? n : 0);                                  \
+        const char *s = (const char *)src + (unlikely(direction) ? n : 0);                      \
+                                                                                                \
+        if (n >= 2 * MEMOP_UNROLL * (vector_size))                                              \
+        {                                                                                       \
+            vec_t cur[MEMOP_UNROLL], next[MEMOP_UNROLL];                                        \
+                                                                                                \
+            LOAD_GROUP_DIR(cur, s, MEMOP_UNROLL, vector_size, direction);                       \
+            n -= MEMOP_UNROLL * (vector_size);                                                  \
+            while (n >= MEMOP_UNROLL * (vector_size))                                           \
+            {                                                                                   \
+                LOAD_GROUP_DIR(next, s, MEMOP_UNROLL, vector_size, direction);                  \
+                STORE_GROUP_DIR(d, cur, MEMOP_UNROLL, vector_size, direction);                  \
+                for (int i = 0; i < MEMOP_UNROLL; i++)                                          \
+                    cur[i] = next[i];                                                           \
+                n -= MEMOP_UNROLL * (vector_size);                                              \
+            }                                                                                   \
+            STORE_GROUP_DIR(d, cur, MEMOP_UNROLL, vector_size, direction);                      \
+        }                                                                                       \
+                                                                                                \
+        memop_##suffix(d - (unlikely(direction) ? n : 0), s - (unlikely(direction) ? n : 0), n, \
+                       direction);                                                              \
+        return dst;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    /* forward only, with non-temporal stores once the destination is vector aligned;           \
+     * the caller fences, so that many of these can share one sfence */                         \
+    NOBUILTIN [[gnu::aligned(vector_size)]]                                                     \
+    static maybe_inlineable void *memop_##suffix##_nt(void *dst, const void *src, size_t n)     \
+    {                                                                                           \
+        typedef char vec_t __attribute__((__vector_size__(vector_size)));                       \
+        char *d = (char *)dst;                                                                  \
+        const char *s = (const char *)src;                                                      \
+        const size_t head = -(uintptr_t)d & ((vector_size) - 1);                                \
+                                                                                                \
+        if (n < head + 4 * (vector_size))                                                       \
+            return memop_##suffix(dst, src, n, 0);                                              \
+                                                                                                \
+        memop_##suffix(d, s, head, 0);                                                          \
+        d += head;                                                                              \
+        s += head;                                                                              \
+        n -= head;                                                                              \
+                                                                                                \
+        while (n >= 4 * (vector_size))                                                          \
+        {                                                                                       \
+            vec_t v[4];                                                                         \
+            LOAD_GROUP_DIR(v, s, 4, vector_size, 0);                                            \
+            for (int i = 0; i < 4; i++)                                                         \
+                __builtin_nontemporal_store(v[i], (vec_t *)d + i);                              \
+            d += 4 * (vector_size);                                                             \
+            n -= 4 * (vector_size);                                                             \
+        }                                                                                       \
+                                                                                                \
+        memop_##suffix(d, s, n, 0);                                                             \
+        return dst;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    NOBUILTIN                                                                                   \
+    static maybe_inlineable void *memop_##suffix##_stream(void *dst, const void *src, size_t n) \
+    {                                                                                           \
+        memop_##suffix##_nt(dst, src, n);                                                       \
+        STREAM_FENCE();                                                                         \
+        return dst;                                                                             \
+    }
+
+#ifdef __aarch64__
+/* every aarch64 cpu has NEON, so its tier needs neither a check nor a target region */
+IMPLEMENT_MEMOP(inline, neon, (1ULL << (NEON_VECTOR_BITS - 3)), MEMOP_TAIL_STEPS)
+IMPLEMENT_COPY2D(neon)
+IMPLEMENT_BSWAP(neon, (1ULL << (NEON_VECTOR_BITS - 3)), BSWAP_MASK_16B)
+IMPLEMENT_PAD(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_MEMOP_NTA(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_SCAN(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_STRCOPY(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_DELTA(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_ZERO(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_SWAP(neon, (1ULL << (NEON_VECTOR_BITS - 3)))
+IMPLEMENT_GATHER(neon)
+
+/* stnp is only a hint, with no promise that the lines skip the cache, so persistent lines are
+ * stored as usual and each one cleaned to the point of persistence right after */
+NOBUILTIN
+static void persist_lines_neon(char *d, const char *s, size_t lines)
+{
+    for (; lines; lines--, d += CACHE_LINE_SIZE, s += CACHE_LINE_SIZE)
+    {
+        __builtin_memcpy_inline(d, s, CACHE_LINE_SIZE);
+        cpu_writeback(d, CACHE_LINE_SIZE);
+    }
+}
+
+/* SVE kernels are vector-length-agnostic: whole vectors of whatever width this cpu has, then
+ * a predicated pair for the rest, so there is no tail and no grid of unrolls */
+#ifndef __ARM_FEATURE_SVE
+#pragma clang attribute push(__attribute__((target("sve"))), apply_to = function)
+#define inlineable_sve
 #else
-#define has_sse2 1
-#define inlineable_sse2 inline
+#define inlineable_sve inline
 #endif
 
-IMPLEMENT_MEMOP(inlineable_sse2, sse2, 1ULL << (SSE2_VECTOR_BITS - 3))
+/* forward, two vectors at a time and then what's left as one predicated pair, each pair loaded
+ * before either half is stored; nt makes the stores non-temporal, nta prefetches the source
+ * for a single use ahead of the loads */
+static FORCEINLINE void sve_copy_fwd(uint8_t *d, const uint8_t *s, size_t n, int nt, int nta)
+{
+    const svbool_t all = svptrue_b8();
+    const size_t vl = svcntb();
+    size_t i = 0;
 
-#ifndef __SSE2__
-#pragma clang attribute pop
-#endif
+    for (; i + 2 * vl <= n; i += 2 * vl)
+    {
+        if (nta)
+        {
+            for (size_t k = 0; k < 2 * vl; k += 64)
+                __builtin_prefetch(s + i + PREFETCH_NTA_DISTANCE + k, 0, 0);
+        }
+        const svuint8_t v0 = svld1_u8(all, s + i);
+        const svuint8_t v1 = svld1_vnum_u8(all, s + i, 1);
+        if (nt)
+        {
+            svstnt1_u8(all, d + i, v0);
+            svstnt1_vnum_u8(all, d + i, 1, v1);
+        }
+        else
+        {
+            svst1_u8(all, d + i, v0);
+            svst1_vnum_u8(all, d + i, 1, v1);
+        }
+    }
 
-NOBUILTIN
-static inline void *memop_scalar(void *dst, const void *src, size_t n, int direction)
+    const svbool_t p0 = svwhilelt_b8_u64(i, n);
+    const svbool_t p1 = svwhilelt_b8_u64(i + vl, n);
+    const svuint8_t v0 = svld1_u8(p0, s + i);
+    const svuint8_t v1 = svld1_vnum_u8(p1, s + i, 1);
+    svst1_u8(p0, d + i, v0);
+    svst1_vnum_u8(p1, d + i, 1, v1);
+}
+
+/* the same from the end down, with the predicated pair at the start */
+static FORCEINLINE void sve_copy_bwd(uint8_t *d, const uint8_t *s, size_t n)
 {
-    char *d = (char *)dst + (unlikely(direction) ? n : 0);
-    const char *s = (const char *)src + (unlikely(direction) ? n : 0);
+    const svbool_t all = svptrue_b8();
+    const size_t vl = svcntb();
 
-    while (n >= 32)
+    for (; n >= 2 * vl; n -= 2 * vl)
     {
-        COPY_DIR(d, s, n, 32, direction);
+        const svuint8_t v0 = svld1_u8(all, s + n - 2 * vl);
+        const svuint8_t v1 = svld1_u8(all, s + n - vl);
+        svst1_u8(all, d + n - vl, v1);
+        svst1_u8(all, d + n - 2 * vl, v0);
     }
 
-    COPY_DIR(d, s, n, 16, direction);
-    COPY_DIR(d, s, n, 8, direction);
-    COPY_DIR(d, s, n, 4, direction);
-    COPY_DIR(d, s, n, 2, direction);
-    COPY_DIR(d, s, n, 1, direction);
+    const svbool_t p0 = svwhilelt_b8_u64(0, n);
+    const svbool_t p1 = svwhilelt_b8_u64(vl, n);
+    const svuint8_t v0 = svld1_u8(p0, s);
+    const svuint8_t v1 = svld1_vnum_u8(p1, s, 1);
+    svst1_u8(p0, d, v0);
+    svst1_vnum_u8(p1, d, 1, v1);
+}
 
+NOBUILTIN
+static inlineable_sve void *memop_sve(void *dst, const void *src, size_t n, int direction)
+{
+    if (likely(!direction))
+        sve_copy_fwd(dst, src, n, 0, 0);
+    else
+        sve_copy_bwd(dst, src, n);
     return dst;
 }
 
-NOBUILTIN NOINLINE 
-void MEMAPI *memcpy_local(void *dst, const void *src, size_t n)
+/* each pair is loaded before it is stored already; the sve tier has no separate ahead loop */
+#define memop_sve_ahead memop_sve
+
+/* the caller fences, as for the other tiers' _nt */
+NOBUILTIN
+static inlineable_sve void *memop_sve_nt(void *dst, const void *src, size_t n)
 {
-    if (has_avx512f)
-        return memop_avx512(dst, src, n, 0);
-    if (has_avx2)
-        return memop_avx2(dst, src, n, 0);
-    if (has_sse2)
-        return memop_sse2(dst, src, n, 0);
-    return memop_scalar(dst, src, n, 0);
+    sve_copy_fwd(dst, src, n, 1, 0);
+    return dst;
 }
 
-NOBUILTIN NOINLINE 
-void MEMAPI *memmove_local(void *dst, const void *src, size_t n)
+NOBUILTIN
+static inlineable_sve void *memop_sve_stream(void *dst, const void *src, size_t n)
 {
-    unsigned char *d = dst;
-    const unsigned char *s = src;
+    sve_copy_fwd(dst, src, n, 1, 0);
+    STREAM_FENCE();
+    return dst;
+}
 
-    if (d == s)
-        return dst;
+NOBUILTIN
+static void *memop_sve_nta(void *dst, const void *src, size_t n, int stream)
+{
+    if (stream)
+    {
+        sve_copy_fwd(dst, src, n, 1, 1);
+        STREAM_FENCE();
+    }
+    else
+        sve_copy_fwd(dst, src, n, 0, 1);
+    return dst;
+}
 
-    if (likely(d < s || d >= s + n))
-        return memcpy_local(dst, src, n);
+IMPLEMENT_COPY2D(sve)
 
-    if (has_avx512f)
-        return memop_avx512(dst, src, n, 1);
-    if (has_avx2)
-        return memop_avx2(dst, src, n, 1);
-    if (has_sse2)
-        return memop_sse2(dst, src, n, 1);
-    return memop_scalar(dst, src, n, 1);
+static int sve_wider_than_neon(void)
+{
+    return svcntb() > (1ULL << (NEON_VECTOR_BITS - 3));
+}
+
+#ifndef __ARM_FEATURE_SVE
+#pragma clang attribute pop
+#endif
+
+/* the sve tier only where its vectors are wider than NEON's: at 128 bits the neon tier's
+ * ldp/stp pairs move as much per instruction, without the predicates */
+static int sve_preference = -1;
+
+static FORCEINLINE int sve_preferred(void)
+{
+    if (unlikely(sve_preference < 0))
+        sve_preference = cpu_supports(FEAT_SVE) && sve_wider_than_neon();
+    return sve_preference;
+}
+
+#define has_sve likely(sve_preferred())
+
+/* there is no AVX-512 to set a policy for, but memop_avx512_policy() still keeps what it is told */
+static int avx512_policy = AVX512_POLICY_ZMM;
+#else
+/* the Makefile has x86 prefer 256-bit vectors, so that no -mtune merges the avx512vl tier's
+ * stores into 512-bit ones; the avx512 tiers ask for their zmm registers back */
+#pragma clang attribute push(__attribute__((min_vector_width(512))), apply_to = function)
+
+#ifndef __AVX512F__
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#define has_avx512f cpu_supports(FEAT_AVX512)
+#define inlineable_avx512f
+#else
+#define has_avx512f 1
+#define inlineable_avx512f inline
+#endif
+
+IMPLEMENT_MEMOP(inlineable_avx512f, avx512, (1ULL << (AVX512_VECTOR_BITS - 3)), MEMOP_TAIL_STEPS)
+IMPLEMENT_COPY2D(avx512)
+IMPLEMENT_BSWAP(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)), BSWAP_MASK_64B)
+IMPLEMENT_PAD(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_PERSIST(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_MEMOP_NTA(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_SWAP(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_GATHER(avx512)
+
+/* 8 and 16 byte records eight at a time with vpgatherqq: the indices widen to quadwords, and
+ * a 16 byte record is the two quadwords at twice its index, gathered apart and then interleaved.
+ * The scatters go back the same way with vpscatterqq, whose lanes land in order so that the
+ * last of several records to the same index wins, as in scatter_fixed_* */
+NOBUILTIN
+static void gather8_avx512(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        PREFETCH_AHEAD(s, idx, i, 8, count, 8, 0);
+        const __m512i q = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(idx + i)));
+        _mm512_storeu_si512(d + i * 8, _mm512_i64gather_epi64(q, s, 8));
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + i * 8, s + (size_t)idx[i] * 8, 8);
+}
+
+NOBUILTIN
+static void gather16_avx512(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    const __m512i first = _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11);
+    const __m512i second = _mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15);
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        PREFETCH_AHEAD(s, idx, i, 8, count, 16, 0);
+        const __m512i q =
+            _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(idx + i))), 1);
+        const __m512i lo = _mm512_i64gather_epi64(q, s, 8), hi = _mm512_i64gather_epi64(q, s + 8, 8);
+        _mm512_storeu_si512(d + i * 16, _mm512_permutex2var_epi64(lo, first, hi));
+        _mm512_storeu_si512(d + i * 16 + 64, _mm512_permutex2var_epi64(lo, second, hi));
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + i * 16, s + (size_t)idx[i] * 16, 16);
+}
+
+NOBUILTIN
+static void scatter8_avx512(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        PREFETCH_AHEAD(d, idx, i, 8, count, 8, 1);
+        const __m512i q = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(idx + i)));
+        _mm512_i64scatter_epi64(d, q, _mm512_loadu_si512(s + i * 8), 8);
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + (size_t)idx[i] * 8, s + i * 8, 8);
+}
+
+NOBUILTIN
+static void scatter16_avx512(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    const __m512i even = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m512i odd = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        PREFETCH_AHEAD(d, idx, i, 8, count, 16, 1);
+        const __m512i q =
+            _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(idx + i))), 1);
+        const __m512i a = _mm512_loadu_si512(s + i * 16), b = _mm512_loadu_si512(s + i * 16 + 64);
+        _mm512_i64scatter_epi64(d, q, _mm512_permutex2var_epi64(a, even, b), 8);
+        _mm512_i64scatter_epi64(d + 8, q, _mm512_permutex2var_epi64(a, odd, b), 8);
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + (size_t)idx[i] * 16, s + i * 16, 16);
+}
+
+#ifndef __AVX512F__
+#pragma clang attribute pop
+#endif
+
+/* byte compares into a mask register need AVX512BW on top of the avx512 tier */
+#ifndef __AVX512BW__
+#pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#define has_avx512bw (has_avx512f && cpu_has_feature(CPU_FEATURE_AVX512BW))
+#else
+#define has_avx512bw 1
+#endif
+
+IMPLEMENT_SCAN(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_STRCOPY(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_DELTA(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+IMPLEMENT_ZERO(avx512, (1ULL << (AVX512_VECTOR_BITS - 3)))
+
+#ifndef __AVX512BW__
+#pragma clang attribute pop
+#endif
+
+#pragma clang attribute pop
+
+/* 256-bit vectors with masked tails: nothing here is a 512-bit instruction, so it
+ * doesn't drop the core into the lower frequency licence those cost on some parts
+ * ("make check" looks for zmm registers in it) */
+#if !defined(__AVX512VL__) || !defined(__AVX512BW__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512vl,avx512bw"))), apply_to = function)
+#define has_avx512vl cpu_supports(FEAT_AVX512VL)
+#define inlineable_avx512vl
+#else
+#define has_avx512vl 1
+#define inlineable_avx512vl inline
+#endif
+
+IMPLEMENT_MEMOP(inlineable_avx512vl, avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)), MEMOP_TAIL_MASKED)
+IMPLEMENT_COPY2D(avx512vl)
+IMPLEMENT_BSWAP(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)), BSWAP_MASK_32B)
+IMPLEMENT_PAD(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_PERSIST(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_MEMOP_NTA(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_SCAN(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_STRCOPY(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_DELTA(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_ZERO(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_SWAP(avx512vl, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_GATHER(avx512vl)
+
+#if !defined(__AVX512VL__) || !defined(__AVX512BW__)
+#pragma clang attribute pop
+#endif
+
+/* the compact build leaves both AVX-512 tiers out of the dispatchers, and so out of the
+ * binary: AVX2 covers the same machines at half the vector width */
+#ifdef MEMBASE_COMPACT
+#undef has_avx512f
+#undef has_avx512bw
+#undef has_avx512vl
+#define has_avx512f 0
+#define has_avx512bw 0
+#define has_avx512vl 0
+#endif
+
+#ifndef AVX512_POLICY
+#define AVX512_POLICY AVX512_POLICY_ZMM
+#endif
+
+static int avx512_policy = AVX512_POLICY;
+
+/* checked ahead of the avx512 tier by every dispatcher */
+#define prefer_avx512vl (unlikely(avx512_policy == AVX512_POLICY_YMM) && has_avx512vl)
+
+#ifndef __AVX2__
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#define has_avx2 likely(cpu_supports(FEAT_AVX2))
+#define inlineable_avx2
+#else
+#define has_avx2 1
+#define inlineable_avx2 inline
+#endif
+
+IMPLEMENT_MEMOP(inlineable_avx2, avx2, (1ULL << (AVX2_VECTOR_BITS - 3)), MEMOP_TAIL_STEPS)
+IMPLEMENT_COPY2D(avx2)
+IMPLEMENT_BSWAP(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)), BSWAP_MASK_32B)
+IMPLEMENT_PAD(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_PERSIST(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_MEMOP_NTA(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_SCAN(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_STRCOPY(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_DELTA(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_ZERO(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_SWAP(avx2, (1ULL << (AVX2_VECTOR_BITS - 3)))
+IMPLEMENT_GATHER(avx2)
+
+/* the avx512 tier's gathers four records at a time; AVX2 has no scatter */
+NOBUILTIN
+static void gather8_avx2(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        PREFETCH_AHEAD(s, idx, i, 4, count, 8, 0);
+        const __m256i q = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(idx + i)));
+        _mm256_storeu_si256((__m256i *)(d + i * 8), _mm256_i64gather_epi64((const long long *)s, q, 8));
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + i * 8, s + (size_t)idx[i] * 8, 8);
+}
+
+NOBUILTIN
+static void gather16_avx2(char *d, const char *s, const uint32_t *idx, size_t count, size_t size)
+{
+    size_t i = 0;
+    (void)size;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        PREFETCH_AHEAD(s, idx, i, 4, count, 16, 0);
+        const __m256i q =
+            _mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(idx + i))), 1);
+        const __m256i lo = _mm256_i64gather_epi64((const long long *)s, q, 8);
+        const __m256i hi = _mm256_i64gather_epi64((const long long *)(s + 8), q, 8);
+        const __m256i even = _mm256_unpacklo_epi64(lo, hi), odd = _mm256_unpackhi_epi64(lo, hi);
+        _mm256_storeu_si256((__m256i *)(d + i * 16), _mm256_permute2x128_si256(even, odd, 0x20));
+        _mm256_storeu_si256((__m256i *)(d + i * 16 + 32), _mm256_permute2x128_si256(even, odd, 0x31));
+    }
+    for (; i < count; i++)
+        __builtin_memcpy_inline(d + i * 16, s + (size_t)idx[i] * 16, 16);
+}
+
+#ifndef __AVX2__
+#pragma clang attribute pop
+#endif
+
+#ifndef __SSE2__
+#pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+#define has_sse2 likely(cpu_supports(FEAT_SSE2))
+#define inlineable_sse2
+#else
+#define has_sse2 1
+#define inlineable_sse2 inline
+#endif
+
+IMPLEMENT_MEMOP(inlineable_sse2, sse2, (1ULL << (SSE2_VECTOR_BITS - 3)), MEMOP_TAIL_STEPS)
+IMPLEMENT_COPY2D(sse2)
+IMPLEMENT_BSWAP(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)), BSWAP_MASK_16B)
+IMPLEMENT_PAD(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_PERSIST(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_MEMOP_NTA(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_SCAN(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_STRCOPY(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_DELTA(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_ZERO(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_SWAP(sse2, (1ULL << (SSE2_VECTOR_BITS - 3)))
+IMPLEMENT_GATHER(sse2)
+
+#ifndef __SSE2__
+#pragma clang attribute pop
+#endif
+#endif
+
+NOBUILTIN
+static inline void *memop_scalar(void *dst, const void *src, size_t n, int direction)
+{
+    char *d = (char *)dst + (unlikely(direction) ? n : 0);
+    const char *s = (const char *)src + (unlikely(direction) ? n : 0);
+
+    while (n >= 32)
+    {
+        COPY_DIR(d, s, n, 32, direction);
+    }
+
+    COPY_DIR(d, s, n, 16, direction);
+    COPY_DIR(d, s, n, 8, direction);
+    COPY_DIR(d, s, n, 4, direction);
+    COPY_DIR(d, s, n, 2, direction);
+    COPY_DIR(d, s, n, 1, direction);
+
+    return dst;
+}
+
+typedef void (*copy2d_fn)(char *d, size_t dpitch, const char *s, size_t spitch, size_t width, size_t height);
+
+IMPLEMENT_COPY2D_FIXED(1)
+IMPLEMENT_COPY2D_FIXED(2)
+IMPLEMENT_COPY2D_FIXED(4)
+IMPLEMENT_COPY2D_FIXED(8)
+IMPLEMENT_COPY2D_FIXED(16)
+IMPLEMENT_COPY2D_FIXED(32)
+IMPLEMENT_COPY2D_FIXED(64)
+IMPLEMENT_COPY2D_RANGE(2)
+IMPLEMENT_COPY2D_RANGE(4)
+IMPLEMENT_COPY2D_RANGE(8)
+IMPLEMENT_COPY2D_RANGE(16)
+IMPLEMENT_COPY2D_RANGE(32)
+
+typedef void (*gather_fn)(char *d, const char *s, const uint32_t *idx, size_t count, size_t size);
+
+GATHER_SIZES(IMPLEMENT_GATHER_FIXED)
+IMPLEMENT_GATHER(scalar)
+
+NOBUILTIN
+static void copy2d_scalar(char *d, size_t dpitch, const char *s, size_t spitch, size_t width, size_t height)
+{
+    COPY2D_ROWS(d, dpitch, s, spitch, height, memop_scalar(d, s, width, 0));
+}
+
+#define IMPLEMENT_BSWAP_SCALAR(bits)                                               \
+    NOBUILTIN                                                                      \
+    static void *memcpy_bswap##bits##_scalar(void *dst, const void *src, size_t n) \
+    {                                                                              \
+        char *d = (char *)dst;                                                     \
+        const char *s = (const char *)src;                                         \
+        BSWAP_TAIL(d, s, n, bits);                                                 \
+        return dst;                                                                \
+    }
+
+IMPLEMENT_BSWAP_SCALAR(16)
+IMPLEMENT_BSWAP_SCALAR(32)
+IMPLEMENT_BSWAP_SCALAR(64)
+
+NOBUILTIN
+static const char *scan_fwd_scalar(const char *str, size_t n, char c)
+{
+    for (; n; n--, str++)
+    {
+        if (*str == c)
+            return str;
+    }
+    return NULL;
+}
+
+NOBUILTIN
+static const char *scan_bwd_scalar(const char *str, size_t n, char c)
+{
+    while (n--)
+    {
+        if (str[n] == c)
+            return str + n;
+    }
+    return NULL;
+}
+
+NOBUILTIN
+static void pad_scalar(char *d, const char *s, size_t n, size_t total, char c)
+{
+    memop_scalar(d, s, n, 0);
+    fill_scalar(d + n, total - n, c);
+}
+
+/* no non-temporal stores without SSE2, so these are cached and written back */
+NOBUILTIN
+static void persist_lines_scalar(char *d, const char *s, size_t lines)
+{
+    memop_scalar(d, s, lines * CACHE_LINE_SIZE, 0);
+    cpu_writeback(d, lines * CACHE_LINE_SIZE);
+}
+
+NOBUILTIN
+static size_t delta_lines_scalar(char *d, const char *s, size_t lines, uint64_t *dirty_lines, size_t line)
+{
+    size_t changed = 0;
+    for (; lines; lines--, line++, d += CACHE_LINE_SIZE, s += CACHE_LINE_SIZE)
+        changed += delta_mark(dirty_lines, line, delta_bytes(d, s, CACHE_LINE_SIZE));
+    return changed;
+}
+
+NOBUILTIN
+static int all_zero_scalar(const char *s, size_t n)
+{
+    return zero_bytes(s, n);
+}
+
+NOBUILTIN
+static void swap_scalar(char *a, char *b, size_t n)
+{
+    swap_bytes(a, b, n);
+}
+
+NOBUILTIN
+static char *strcopy_scalar(char *dst, const char *src, size_t n)
+{
+    for (; n; n--, dst++, src++)
+    {
+        if (!(*dst = *src))
+            return dst;
+    }
+    return NULL;
+}
+
+/* the scalar tier under the names the dispatchers call the others by */
+#define memop_scalar_ahead memop_scalar
+#define memop_scalar_stream(dst, src, n) memop_scalar(dst, src, n, 0)
+#define memop_scalar_nta(dst, src, n, stream) memop_scalar(dst, src, n, 0)
+#define copy2d_scalar_stream copy2d_scalar
+
+/* the tiers a dispatcher picks from, best first: call(suffix, tier, ...) for the first one this
+ * cpu has. The copy engines have an sve tier on aarch64, where the other kernels are neon only;
+ * on x86 the byte compares into a mask register want AVX512BW on top of the avx512 tier */
+#ifdef __aarch64__
+#define COPY_TIERS(call, ...) \
+    (has_sve ? call(sve, MEMBASE_TIER_SVE, __VA_ARGS__) : call(neon, MEMBASE_TIER_NEON, __VA_ARGS__))
+#define VECTOR_TIERS(call, ...) call(neon, MEMBASE_TIER_NEON, __VA_ARGS__)
+#define BYTE_TIERS(call, ...) call(neon, MEMBASE_TIER_NEON, __VA_ARGS__)
+#else
+#define TIER_CHAIN(has_avx512_tier, call, ...)                                 \
+    (prefer_avx512vl     ? call(avx512vl, MEMBASE_TIER_AVX512VL, __VA_ARGS__) \
+     : (has_avx512_tier) ? call(avx512, MEMBASE_TIER_AVX512, __VA_ARGS__)     \
+     : has_avx2          ? call(avx2, MEMBASE_TIER_AVX2, __VA_ARGS__)         \
+     : has_sse2          ? call(sse2, MEMBASE_TIER_SSE2, __VA_ARGS__)         \
+                         : call(scalar, MEMBASE_TIER_SCALAR, __VA_ARGS__))
+#define COPY_TIERS(call, ...) TIER_CHAIN(has_avx512f, call, __VA_ARGS__)
+#define VECTOR_TIERS(call, ...) TIER_CHAIN(has_avx512f, call, __VA_ARGS__)
+#define BYTE_TIERS(call, ...) TIER_CHAIN(has_avx512bw, call, __VA_ARGS__)
+#endif
+
+/* prefix_<suffix>postfix(...), the second counted under its tier in a MEMBASE_STATS build */
+#define TIER_CALL(suffix, tier, prefix, postfix, ...) prefix##_##suffix##postfix(__VA_ARGS__)
+#define TIER_CALL_COUNTED(suffix, tier, prefix, postfix, ...) \
+    STAT_TIER(tier, prefix##_##suffix##postfix(__VA_ARGS__))
+
+static const struct memop_engine engines[] = {
+#ifdef __aarch64__
+    {"sve", memop_sve, FEAT_SVE, 1},
+    MEMOP_GRID_ENGINES(neon, FEAT_NEON),
+#else
+#ifndef MEMBASE_COMPACT
+    MEMOP_GRID_ENGINES(avx512, FEAT_AVX512),
+    MEMOP_GRID_ENGINES(avx512vl, FEAT_AVX512VL),
+#endif
+    MEMOP_GRID_ENGINES(avx2, FEAT_AVX2),
+    MEMOP_GRID_ENGINES(sse2, FEAT_SSE2),
+#endif
+    {"scalar", memop_scalar, 0, 1}};
+
+/* every generated engine, for benchmarking; callers check cpu_supports(feature) first */
+const struct memop_engine MEMAPI *memop_engines(size_t *count)
+{
+    *count = sizeof(engines) / sizeof(engines[0]);
+    return engines;
+}
+
+/* sets the AVX-512 tier the dispatchers use (negative just queries it) and returns the previous
+ * policy; meant to be set once at startup, before other threads copy anything */
+int MEMAPI memop_avx512_policy(int policy)
+{
+    const int previous = avx512_policy;
+    if (policy >= 0)
+        avx512_policy = policy;
+    return previous;
+}
+
+size_t MEMAPI membase_cache_size(int level)
+{
+    return cpu_cache_size(level);
+}
+
+#ifdef MEMBASE_STATS
+/* each thread counts into a block of its own, so that counting is a plain add to a line
+ * nobody else writes; blocks are never freed, a thread that exits leaves its block (and its
+ * counts) to the next new thread, and snapshots add up all of them */
+struct stats_block
+{
+    struct membase_stats stats;
+    struct stats_block *next;
+    int in_use;
+};
+
+static struct stats_block *stats_blocks;
+/* for threads that couldn't get a block of their own; shared, so its counts may lose a few adds */
+static struct stats_block stats_fallback = {.in_use = 1};
+static _Thread_local struct stats_block *stats_self;
+
+#ifdef _WIN32
+static DWORD stats_key = FLS_OUT_OF_INDEXES;
+
+static void WINAPI stats_release(void *block)
+{
+    __atomic_store_n(&((struct stats_block *)block)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static BOOL CALLBACK stats_key_create(PINIT_ONCE once, void *param, void **context)
+{
+    (void)once, (void)param, (void)context;
+    stats_key = FlsAlloc(stats_release);
+    return TRUE;
+}
+
+static void stats_register(struct stats_block *block)
+{
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, stats_key_create, NULL, NULL);
+    if (stats_key != FLS_OUT_OF_INDEXES)
+        FlsSetValue(stats_key, block);
+}
+
+/* no thread may call back into a library that is gone: run from DLL_PROCESS_DETACH, and
+ * FlsFree() releases whatever blocks are still registered while the image is there */
+__attribute__((destructor)) static void stats_shutdown(void)
+{
+    if (stats_key != FLS_OUT_OF_INDEXES)
+        FlsFree(stats_key);
+}
+#else
+static pthread_key_t stats_key;
+static int stats_key_valid;
+
+static void stats_release(void *block)
+{
+    __atomic_store_n(&((struct stats_block *)block)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void stats_key_create(void)
+{
+    stats_key_valid = !pthread_key_create(&stats_key, stats_release);
+}
+
+static void stats_register(struct stats_block *block)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, stats_key_create);
+    if (stats_key_valid)
+        pthread_setspecific(stats_key, block);
+}
+
+/* no thread may call back into a library that is gone */
+__attribute__((destructor)) static void stats_shutdown(void)
+{
+    if (stats_key_valid)
+        pthread_key_delete(stats_key);
+}
+#endif
+
+static NOINLINE struct stats_block *stats_claim(void)
+{
+    struct stats_block *block;
+
+    for (block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block; block = block->next)
+    {
+        if (!__atomic_load_n(&block->in_use, __ATOMIC_RELAXED) &&
+            !__atomic_exchange_n(&block->in_use, 1, __ATOMIC_ACQUIRE))
+            break;
+    }
+
+    if (!block)
+    {
+        block = calloc(1, sizeof(*block));
+        if (!block)
+            return &stats_fallback;
+        block->in_use = 1;
+        block->next = __atomic_load_n(&stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+            ;
+    }
+    stats_register(block);
+    return block;
+}
+
+static FORCEINLINE struct membase_stats *stats_local(void)
+{
+    if (unlikely(!stats_self))
+        stats_self = stats_claim();
+    return &stats_self->stats;
+}
+
+/* only the owner writes a counter, so a load and a store will do; they're atomic for the snapshots */
+static FORCEINLINE void stat_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static FORCEINLINE size_t stats_bucket(size_t n)
+{
+    return n ? 64 - __builtin_clzll(n) : 0;
+}
+
+static void stats_sum(struct membase_stats *total, const struct membase_stats *block)
+{
+    const uint64_t *from = (const uint64_t *)block;
+    uint64_t *to = (uint64_t *)total;
+
+    for (size_t i = 0; i < sizeof(*block) / sizeof(uint64_t); i++)
+        to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+int MEMAPI membase_stats_snapshot(struct membase_stats *stats)
+{
+    *stats = (struct membase_stats){0};
+    for (struct stats_block *block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE); block; block = block->next)
+        stats_sum(stats, &block->stats);
+    stats_sum(stats, &stats_fallback.stats);
+    return 1;
+}
+
+#define STAT_ADD(field, value) stat_add(&stats_local()->field, value)
+#define STAT_TIER(tier, call) (STAT_ADD(tiers[tier], 1), (call))
+/* a kernel run of n bytes, with streaming or ordinary stores */
+static FORCEINLINE void stat_path(int stream, size_t n)
+{
+    struct membase_stats *stats = stats_local();
+
+    if (stream)
+    {
+        stat_add(&stats->streaming, 1);
+        stat_add(&stats->streaming_bytes, n);
+    }
+    else
+    {
+        stat_add(&stats->cached, 1);
+        stat_add(&stats->cached_bytes, n);
+    }
+}
+
+/* a memcpy_local()/memmove_local() call of n bytes, counted on the way in so the copy stays a tail call */
+static FORCEINLINE void stat_call(size_t n)
+{
+    struct membase_stats *stats = stats_local();
+    const size_t bucket = stats_bucket(n);
+
+    stat_add(&stats->calls[bucket], 1);
+    stat_add(&stats->bytes[bucket], n);
+}
+
+#ifdef MEMBASE_STATS_CYCLES
+#ifdef __aarch64__
+/* the generic timer, the nearest thing aarch64 has to the TSC */
+static FORCEINLINE uint64_t cpu_ticks(void)
+{
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+}
+#else
+#define cpu_ticks() __rdtsc()
+#endif
+
+/* with the call itself timed, which costs a frame and a pair of rdtsc */
+#define RETURN_TIMED(n, call)                                                    \
+    do                                                                           \
+    {                                                                            \
+        const uint64_t start_ = cpu_ticks();                                     \
+        call;                                                                    \
+        stat_add(&stats_local()->cycles[stats_bucket(n)], cpu_ticks() - start_); \
+        return dst;                                                              \
+    } while (0)
+#endif
+#else
+int MEMAPI membase_stats_snapshot(struct membase_stats *stats)
+{
+    *stats = (struct membase_stats){0};
+    return 0;
+}
+
+#define STAT_ADD(field, value) ((void)0)
+#define STAT_TIER(tier, call) (call)
+#define stat_path(stream, n) ((void)0)
+#define stat_call(n) ((void)0)
+#endif
+
+#ifndef RETURN_TIMED
+#define RETURN_TIMED(n, call) return call
+#endif
+
+/* distance, modulo a page, by which the loads run ahead of the stores issued
+ * before them; small nonzero distances are the ones that hit 4K aliasing */
+static FORCEINLINE size_t alias_distance(const void *dst, const void *src, int direction)
+{
+    uintptr_t delta = likely(!direction) ? (uintptr_t)dst - (uintptr_t)src : (uintptr_t)src - (uintptr_t)dst;
+    return delta & (ALIAS_PAGE_SIZE - 1);
+}
+
+static FORCEINLINE int aliases_4k(const void *dst, const void *src, size_t n, int direction)
+{
+    return n >= ALIAS_MIN_SIZE && alias_distance(dst, src, direction) - 1 < ALIAS_WINDOW - 1;
+}
+
+static FORCEINLINE void *memop_dispatch(void *dst, const void *src, size_t n, int direction)
+{
+    stat_path(0, n);
+    return COPY_TIERS(TIER_CALL_COUNTED, memop, , dst, src, n, direction);
+}
+
+static FORCEINLINE void *memop_dispatch_ahead(void *dst, const void *src, size_t n, int direction)
+{
+    stat_path(0, n);
+    return COPY_TIERS(TIER_CALL_COUNTED, memop, _ahead, dst, src, n, direction);
+}
+
+static FORCEINLINE void *memop_dispatch_stream(void *dst, const void *src, size_t n)
+{
+    stat_path(1, n);
+    return COPY_TIERS(TIER_CALL_COUNTED, memop, _stream, dst, src, n);
+}
+
+static FORCEINLINE void *memop_dispatch_nta(void *dst, const void *src, size_t n, int stream)
+{
+    stat_path(stream, n);
+    return COPY_TIERS(TIER_CALL_COUNTED, memop, _nta, dst, src, n, stream);
+}
+
+static FORCEINLINE void *copy_disjoint(void *dst, const void *src, size_t n)
+{
+    /* nothing overlaps, so an aliasing forward copy can simply run backwards,
+     * which puts the loads almost a full page away from the stores instead */
+    if (unlikely(aliases_4k(dst, src, n, 0)))
+    {
+        STAT_ADD(alias_reversed, 1);
+        return memop_dispatch(dst, src, n, 1);
+    }
+    return memop_dispatch(dst, src, n, 0);
+}
+
+/* dst > src: walking down in chunks of the overlap distance, each chunk's source
+ * and destination are disjoint, and its destination only covers source bytes
+ * that the chunk above it has already read, so every chunk is a plain forward copy */
+static FORCEINLINE void *memmove_split_backward(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    const size_t distance = d - s;
+    const int stream = n >= STREAMING_THRESHOLD;
+
+    while (n > distance)
+    {
+        n -= distance;
+        if (stream)
+            memop_dispatch_stream(d + n, s + n, distance);
+        else
+            copy_disjoint(d + n, s + n, distance);
+    }
+
+    if (stream)
+        memop_dispatch_stream(d, s, n);
+    else
+        copy_disjoint(d, s, n);
+    return dst;
+}
+
+NOBUILTIN NOINLINE 
+void MEMAPI *memcpy_local(void *dst, const void *src, size_t n)
+{
+    stat_call(n);
+    RETURN_TIMED(n, copy_disjoint(dst, src, n));
+}
+
+/* X(size, alignment, count) for the hottest pairs of a recorded histogram, generated by
+ * "make PROFILE=..."; alignment is the largest power of two (up to 64) dividing both pointers */
+#ifdef MEMBASE_PROFILE
+#include "membase_profile.h"
+#else
+#define MEMBASE_PROFILE_SIZES(X)
+#endif
+
+#define PROFILE_COPY(size, alignment, count)                                            \
+    _Static_assert((size) > 0 && (alignment) > 0 && !((alignment) & ((alignment) - 1)), \
+                   "profile pairs need a size and a power of two alignment");           \
+    if (n == (size) && !(((uintptr_t)dst | (uintptr_t)src) & ((alignment) - 1)))        \
+    {                                                                                   \
+        __builtin_memcpy_inline(__builtin_assume_aligned(dst, alignment),               \
+                                __builtin_assume_aligned(src, alignment), size);        \
+        return dst;                                                                     \
+    }
+
+/* the pairs are checked in order, so the hottest costs one size compare (and an alignment test
+ * unless that is 1) before its copy, and everything else one per pair before the generic
+ * dispatch; only the calls that get that far count in the stats */
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_profiled(void *dst, const void *src, size_t n)
+{
+    MEMBASE_PROFILE_SIZES(PROFILE_COPY)
+    stat_call(n);
+    RETURN_TIMED(n, copy_disjoint(dst, src, n));
+}
+
+static FORCEINLINE void *memmove_dispatch(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    if (d == s)
+    {
+        STAT_ADD(memmove_same, 1);
+        return dst;
+    }
+
+    if (likely(d + n <= s || d >= s + n))
+    {
+        STAT_ADD(memmove_disjoint, 1);
+        return copy_disjoint(dst, src, n);
+    }
+
+    /* overlapping, so the direction is fixed; keep the loads a group ahead instead */
+    const int direction = d > s;
+    if (direction)
+        STAT_ADD(memmove_backward, 1);
+    else
+        STAT_ADD(memmove_forward, 1);
+    if (direction && (size_t)(d - s) >= MEMMOVE_SPLIT_MIN)
+    {
+        STAT_ADD(memmove_split, 1);
+        return memmove_split_backward(dst, src, n);
+    }
+    if (unlikely(aliases_4k(dst, src, n, direction)))
+    {
+        STAT_ADD(memmove_ahead, 1);
+        return memop_dispatch_ahead(dst, src, n, direction);
+    }
+    return memop_dispatch(dst, src, n, direction);
+}
+
+NOBUILTIN NOINLINE 
+void MEMAPI *memmove_local(void *dst, const void *src, size_t n)
+{
+    stat_call(n);
+    RETURN_TIMED(n, memmove_dispatch(dst, src, n));
+}
+
+#define COPY2D_KERNEL(suffix, tier, stream) (stream ? copy2d_##suffix##_stream : copy2d_##suffix)
+
+/* picks the row kernel once per 2D/3D copy, from the row width and the total size */
+static copy2d_fn resolve_copy2d(size_t width, size_t total)
+{
+    switch (width)
+    {
+    case 1: return copy2d_fixed_1;
+    case 2: return copy2d_fixed_2;
+    case 4: return copy2d_fixed_4;
+    case 8: return copy2d_fixed_8;
+    case 16: return copy2d_fixed_16;
+    case 32: return copy2d_fixed_32;
+    case 64: return copy2d_fixed_64;
+    }
+
+    if (width < 4)
+        return copy2d_range_2;
+    if (width < 8)
+        return copy2d_range_4;
+    if (width < 16)
+        return copy2d_range_8;
+    if (width < 32)
+        return copy2d_range_16;
+    if (width < 64)
+        return copy2d_range_32;
+
+    const int stream = total >= STREAMING_THRESHOLD;
+    return COPY_TIERS(COPY2D_KERNEL, stream);
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy2d(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height)
+{
+    if (unlikely(!width || !height))
+        return dst;
+
+    /* rows without gaps are just one long row */
+    if (dpitch == width && spitch == width)
+    {
+        if (width * height >= STREAMING_THRESHOLD)
+            return memop_dispatch_stream(dst, src, width * height);
+        return copy_disjoint(dst, src, width * height);
+    }
+
+    resolve_copy2d(width, width * height)(dst, dpitch, src, spitch, width, height);
+    return dst;
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy3d(void *dst, size_t dpitch, size_t dslice, const void *src, size_t spitch, size_t sslice,
+                      size_t width, size_t height, size_t depth)
+{
+    if (unlikely(!width || !height || !depth))
+        return dst;
+
+    /* slices without gaps are just more rows */
+    if (dslice == dpitch * height && sslice == spitch * height)
+        return memcpy2d(dst, dpitch, src, spitch, width, height * depth);
+
+    char *d = dst;
+    const char *s = src;
+    copy2d_fn copy_slice = resolve_copy2d(width, width * height * depth);
+
+    for (size_t slice = 0; slice < depth; slice++)
+        copy_slice(d + slice * dslice, dpitch, s + slice * sslice, spitch, width, height);
+    return dst;
+}
+
+#define IMPLEMENT_BSWAP_DISPATCH(bits)                                     \
+    NOBUILTIN NOINLINE                                                     \
+    void MEMAPI *memcpy_bswap##bits(void *dst, const void *src, size_t n)  \
+    {                                                                      \
+        return VECTOR_TIERS(TIER_CALL, memcpy_bswap##bits, , dst, src, n); \
+    }
+
+IMPLEMENT_BSWAP_DISPATCH(16)
+IMPLEMENT_BSWAP_DISPATCH(32)
+IMPLEMENT_BSWAP_DISPATCH(64)
+
+static FORCEINLINE const char *scan_fwd(const char *str, size_t n, char c)
+{
+    return BYTE_TIERS(TIER_CALL, scan_fwd, , str, n, c);
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memchr_local(const void *s, int c, size_t n)
+{
+    if (unlikely(!n))
+        return NULL;
+    return (void *)scan_fwd(s, n, (char)c);
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memrchr_local(const void *s, int c, size_t n)
+{
+    if (unlikely(!n))
+        return NULL;
+    return (void *)BYTE_TIERS(TIER_CALL, scan_bwd, , s, n, (char)c);
+}
+
+NOBUILTIN NOINLINE
+size_t MEMAPI strlen_local(const char *s)
+{
+    return scan_fwd(s, SIZE_MAX, 0) - s;
+}
+
+NOBUILTIN NOINLINE
+size_t MEMAPI strnlen_local(const char *s, size_t maxlen)
+{
+    if (unlikely(!maxlen))
+        return 0;
+    const char *end = scan_fwd(s, maxlen, 0);
+    return end ? (size_t)(end - s) : maxlen;
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_pad(void *dst, const void *src, size_t n, size_t total, int fill)
+{
+    if (unlikely(n > total))
+        n = total;
+    VECTOR_TIERS(TIER_CALL, pad, , dst, src, n, total, (char)fill);
+    return dst;
+}
+
+static FORCEINLINE char *strcopy(char *dst, const char *src, size_t n)
+{
+    return BYTE_TIERS(TIER_CALL, strcopy, , dst, src, n);
+}
+
+NOBUILTIN NOINLINE
+char MEMAPI *stpcpy_local(char *dst, const char *src)
+{
+    return strcopy(dst, src, SIZE_MAX);
+}
+
+/* the zero fill picks up where the copy's last store left off */
+NOBUILTIN NOINLINE
+char MEMAPI *stpncpy_local(char *dst, const char *src, size_t n)
+{
+    if (unlikely(!n))
+        return dst;
+
+    char *end = strcopy(dst, src, n);
+    if (!end)
+        return dst + n;
+
+    const size_t rest = dst + n - end - 1;
+    VECTOR_TIERS(TIER_CALL, fill, , end + 1, rest, 0);
+    return end;
+}
+
+NOBUILTIN NOINLINE
+size_t MEMAPI strlcpy_local(char *dst, const char *src, size_t size)
+{
+    if (unlikely(!size))
+        return strlen_local(src);
+
+    char *end = strcopy(dst, src, size - 1);
+    if (end)
+        return end - dst;
+
+    dst[size - 1] = '\0';
+    return size - 1 + strlen_local(src + size - 1);
+}
+
+/* the partial lines at either end go through the cache and are written back right away,
+ * while they are still in L1 */
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_persist(void *dst, const void *src, size_t n)
+{
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    const size_t head = -(uintptr_t)d & (CACHE_LINE_SIZE - 1);
+
+    if (n < head + CACHE_LINE_SIZE)
+    {
+        memop_dispatch(d, s, n, 0);
+        cpu_writeback(d, n);
+        cpu_persist_fence();
+        return dst;
+    }
+
+    memop_dispatch(d, s, head, 0);
+    cpu_writeback(d, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    const size_t lines = n / CACHE_LINE_SIZE;
+    VECTOR_TIERS(TIER_CALL, persist_lines, , d, s, lines);
+    d += lines * CACHE_LINE_SIZE;
+    s += lines * CACHE_LINE_SIZE;
+    n -= lines * CACHE_LINE_SIZE;
+
+    memop_dispatch(d, s, n, 0);
+    cpu_writeback(d, n);
+    cpu_persist_fence();
+    return dst;
+}
+
+/* the partial lines at either end are compared and stored a byte at a time */
+NOBUILTIN NOINLINE
+size_t MEMAPI memcpy_delta(void *dst, const void *src, size_t n, uint64_t *dirty_lines)
+{
+    char *d = (char *)dst;
+    const char *s = (const char *)src;
+    size_t head = -(uintptr_t)d & (CACHE_LINE_SIZE - 1), line = 0, changed = 0;
+
+    if (dirty_lines)
+    {
+        for (size_t i = 0; i < (MEMCPY_DELTA_LINES(dst, n) + 63) / 64; i++)
+            dirty_lines[i] = 0;
+    }
+
+    if (head)
+    {
+        head = head < n ? head : n;
+        changed = delta_mark(dirty_lines, line++, delta_bytes(d, s, head));
+        d += head;
+        s += head;
+        n -= head;
+    }
+
+    const size_t lines = n / CACHE_LINE_SIZE;
+    if (lines)
+        changed += BYTE_TIERS(TIER_CALL, delta_lines, , d, s, lines, dirty_lines, line);
+    d += lines * CACHE_LINE_SIZE;
+    s += lines * CACHE_LINE_SIZE;
+    n -= lines * CACHE_LINE_SIZE;
+    line += lines;
+
+    return changed + delta_mark(dirty_lines, line, delta_bytes(d, s, n));
+}
+
+static FORCEINLINE int all_zero(const char *s, size_t n)
+{
+    return BYTE_TIERS(TIER_CALL, all_zero, , s, n);
+}
+
+/* the non-zero pages seen since the last zero one, copied together */
+static FORCEINLINE void copy_sparse_run(char *d, const char *s, size_t run, int stream)
+{
+    if (!run)
+        return;
+    if (stream)
+        memop_dispatch_stream(d - run, s - run, run);
+    else
+        copy_disjoint(d - run, s - run, run);
+}
+
+/* each page is checked when it comes up, but copied only once the next zero page (or the end)
+ * does, so that runs of non-zero pages go in one copy */
+NOBUILTIN NOINLINE
+size_t MEMAPI memcpy_sparse(void *dst, const void *src, size_t n, uint64_t *zero_pages)
+{
+    char *d = dst;
+    const char *s = src;
+    const int stream = n >= STREAMING_THRESHOLD;
+    size_t zero = 0, page = 0, run = 0;
+    uint64_t bits = 0;
+
+    while (n)
+    {
+        size_t chunk = MEMCPY_SPARSE_PAGE_SIZE - ((uintptr_t)d & (MEMCPY_SPARSE_PAGE_SIZE - 1));
+        chunk = chunk < n ? chunk : n;
+
+        if (all_zero(s, chunk))
+        {
+            copy_sparse_run(d, s, run, stream);
+            run = 0;
+            bits |= 1ULL << (page & 63);
+            zero++;
+        }
+        else
+            run += chunk;
+
+        d += chunk;
+        s += chunk;
+        n -= chunk;
+        if ((++page & 63) == 0 || !n)
+        {
+            if (zero_pages)
+                zero_pages[(page - 1) / 64] = bits;
+            bits = 0;
+        }
+    }
+
+    copy_sparse_run(d, s, run, stream);
+    return zero;
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI memswap_local(void *a, void *b, size_t n)
+{
+    if (a == b)
+        return;
+    VECTOR_TIERS(TIER_CALL, swap, , a, b, n);
+}
+
+/* Gries and Mills' block swaps: exchanging the shorter side with the end of the longer one
+ * next to it puts one of the two in its final place and leaves a smaller rotation of the
+ * rest, so the bytes move about twice without any buffer. Once a side is this short, it goes
+ * through the stack instead, and the longer one moves only once */
+#define ROTATE_BUFFER_SIZE 256
+
+NOBUILTIN NOINLINE
+void MEMAPI *memrotate_local(void *buf, size_t n, size_t shift)
+{
+    char *p = buf;
+    size_t left = n ? shift % n : 0, right = n - left;
+    char tmp[ROTATE_BUFFER_SIZE];
+
+    while (left > ROTATE_BUFFER_SIZE && right > ROTATE_BUFFER_SIZE)
+    {
+        if (left <= right)
+        {
+            VECTOR_TIERS(TIER_CALL, swap, , p, p + left, left);
+            p += left;
+            right -= left;
+        }
+        else
+        {
+            VECTOR_TIERS(TIER_CALL, swap, , p + left - right, p + left, right);
+            left -= right;
+        }
+    }
+
+    if (!left || !right)
+        return buf;
+    if (left <= right)
+    {
+        memop_dispatch(tmp, p, left, 0);
+        memop_dispatch(p, p + left, right, 0);
+        memop_dispatch(p + right, tmp, left, 0);
+    }
+    else
+    {
+        memop_dispatch(tmp, p + left, right, 0);
+        memop_dispatch(p + right, p, left, 1);
+        memop_dispatch(p, tmp, right, 0);
+    }
+    return buf;
+}
+
+#define GATHER_FIXED_KERNEL(size) \
+    case size:                    \
+        return scatter ? scatter_fixed_##size : gather_fixed_##size;
+#define GATHER_KERNEL(suffix, tier, scatter) (scatter ? scatter_##suffix : gather_##suffix)
+
+/* picks the record kernel once per call, as resolve_copy2d does for rows: vector gathers and
+ * scatters for the smallest records where there are any, then an inline copy for each size of
+ * GATHER_SIZES, then a tier's engines */
+static gather_fn resolve_gather(size_t size, int scatter)
+{
+#ifndef __aarch64__
+    if (has_avx512f && !prefer_avx512vl)
+    {
+        if (size == 8)
+            return scatter ? scatter8_avx512 : gather8_avx512;
+        if (size == 16)
+            return scatter ? scatter16_avx512 : gather16_avx512;
+    }
+    if (!scatter && has_avx2)
+    {
+        if (size == 8)
+            return gather8_avx2;
+        if (size == 16)
+            return gather16_avx2;
+    }
+#endif
+
+    switch (size)
+    {
+        GATHER_SIZES(GATHER_FIXED_KERNEL)
+    }
+
+    return VECTOR_TIERS(GATHER_KERNEL, scatter);
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_gather(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size)
+{
+    if (likely(count && size))
+        resolve_gather(size, 0)(dst, src, idx, count, size);
+    return dst;
+}
+
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_scatter(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size)
+{
+    if (likely(count && size))
+        resolve_gather(size, 1)(dst, src, idx, count, size);
+    return dst;
+}
+
+#ifdef CPU_FEATURE_CLDEMOTE
+/* moves each line of the n bytes at p out of this core's caches to a shared level,
+ * where another core's reads find it sooner */
+__attribute__((target("cldemote"))) static void demote_lines(const void *p, size_t n)
+{
+    const char *line = (const char *)((uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    for (; line < (const char *)p + n; line += CACHE_LINE_SIZE)
+        __builtin_ia32_cldemote(line);
+}
+#endif
+
+/* without hints the destination streams past STREAMING_THRESHOLD, as in memcpy2d */
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_hint(void *dst, const void *src, size_t n, int flags)
+{
+    const int nta = (flags & MEMCPY_HINT_NTA_SRC) && !(flags & MEMCPY_HINT_KEEP_SRC);
+    const int stream =
+        !(flags & MEMCPY_HINT_KEEP_DST) && ((flags & MEMCPY_HINT_STREAM_DST) || n >= STREAMING_THRESHOLD);
+
+    if (nta)
+        memop_dispatch_nta(dst, src, n, stream);
+    else if (stream)
+        memop_dispatch_stream(dst, src, n);
+    else
+        copy_disjoint(dst, src, n);
+
+#ifdef CPU_FEATURE_CLDEMOTE
+    if ((flags & MEMCPY_HINT_DEMOTE_DST) && !stream && cpu_has_feature(CPU_FEATURE_CLDEMOTE))
+        demote_lines(dst, n);
+#endif
+    return dst;
+}
+
+/* memcpy_async() queue: a bounded ring where each slot's sequence number says whose turn
+ * it is (its ticket to fill, or that ticket + 1 to drain), so producers claim tickets with
+ * one CAS and the single copy thread drains them in order without locks. completed is the
+ * last ticket copied; a copy thread with nothing to do sleeps on a semaphore that producers
+ * only post when it says it is asleep. Shutting down closes the tail (ASYNC_CLOSED), so that
+ * every ticket claimed before is drained and every copy after runs inline. */
+struct async_slot
+{
+    uint64_t seq;
+    void *dst;
+    const void *src;
+    size_t n;
+};
+
+#ifdef _WIN32
+typedef HANDLE async_thread;
+typedef HANDLE async_sem;
+#else
+typedef pthread_t async_thread;
+typedef sem_t async_sem;
+#endif
+
+static struct
+{
+    struct async_slot slots[ASYNC_RING_SIZE];
+    __attribute__((aligned(CACHE_LINE_SIZE))) uint64_t tail;
+    __attribute__((aligned(CACHE_LINE_SIZE))) uint64_t completed;
+    __attribute__((aligned(CACHE_LINE_SIZE))) int sleeping;
+    int stop;
+    int started;
+    async_sem wake;
+    async_thread thread;
+} async_queue;
+
+#ifdef __aarch64__
+#define CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define CPU_PAUSE() __builtin_ia32_pause()
+#endif
+
+static void async_drain(void)
+{
+    uint64_t head = async_queue.completed;
+
+    for (;;)
+    {
+        struct async_slot *slot = &async_queue.slots[head & (ASYNC_RING_SIZE - 1)];
+        int spins = 0;
+        while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != head + 1)
+        {
+            if (++spins < ASYNC_SPIN)
+            {
+                CPU_PAUSE();
+                continue;
+            }
+            if (__atomic_load_n(&async_queue.stop, __ATOMIC_ACQUIRE))
+                return;
+            __atomic_store_n(&async_queue.sleeping, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == head + 1 ||
+                __atomic_load_n(&async_queue.stop, __ATOMIC_SEQ_CST))
+            {
+                __atomic_store_n(&async_queue.sleeping, 0, __ATOMIC_RELAXED);
+                continue;
+            }
+#ifdef _WIN32
+            WaitForSingleObject(async_queue.wake, INFINITE);
+#else
+            while (sem_wait(&async_queue.wake))
+                ;
+#endif
+            spins = 0;
+        }
+
+        void *dst = slot->dst;
+        const void *src = slot->src;
+        const size_t n = slot->n;
+        __atomic_store_n(&slot->seq, head + ASYNC_RING_SIZE, __ATOMIC_RELEASE);
+
+        /* the stream kernels end in an sfence, so the copy is visible before completed is */
+        memop_dispatch_stream(dst, src, n);
+        __atomic_store_n(&async_queue.completed, ++head, __ATOMIC_RELEASE);
+    }
+}
+
+#ifdef _WIN32
+/* the copy thread holds a reference on the module it runs in, so that FreeLibrary() cannot
+ * unmap it underneath; memcpy_async_shutdown() stops it and lets the module go */
+static DWORD WINAPI async_thread_main(void *arg)
+{
+    async_drain();
+    FreeLibraryAndExitThread((HMODULE)arg, 0);
+}
+
+static BOOL CALLBACK async_start(PINIT_ONCE once, void *param, void **context)
+{
+    (void)once, (void)param, (void)context;
+    HMODULE self;
+    for (uint64_t i = 0; i < ASYNC_RING_SIZE; i++)
+        async_queue.slots[i].seq = i;
+    if ((__atomic_load_n(&async_queue.tail, __ATOMIC_ACQUIRE) & ASYNC_CLOSED) ||
+        !GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)async_drain, &self))
+        return TRUE;
+    async_queue.wake = CreateSemaphoreA(NULL, 0, 0x7fffffff, NULL);
+    async_queue.thread = async_queue.wake ? CreateThread(NULL, 0, async_thread_main, self, 0, NULL) : NULL;
+    async_queue.started = async_queue.thread != NULL;
+    if (!async_queue.started)
+    {
+        if (async_queue.wake)
+            CloseHandle(async_queue.wake);
+        FreeLibrary(self);
+    }
+    return TRUE;
+}
+
+static void async_init(void)
+{
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce(&once, async_start, NULL, NULL);
+}
+
+static void async_wake(void)
+{
+    ReleaseSemaphore(async_queue.wake, 1, NULL);
+}
+
+static void async_join(void)
+{
+    WaitForSingleObject(async_queue.thread, INFINITE);
+    CloseHandle(async_queue.thread);
+    CloseHandle(async_queue.wake);
+}
+
+static void async_yield(void)
+{
+    SwitchToThread();
+}
+#else
+static void *async_thread_main(void *arg)
+{
+    (void)arg;
+    async_drain();
+    return NULL;
+}
+
+static void async_start(void)
+{
+    for (uint64_t i = 0; i < ASYNC_RING_SIZE; i++)
+        async_queue.slots[i].seq = i;
+    if ((__atomic_load_n(&async_queue.tail, __ATOMIC_ACQUIRE) & ASYNC_CLOSED) || sem_init(&async_queue.wake, 0, 0))
+        return;
+    async_queue.started = !pthread_create(&async_queue.thread, NULL, async_thread_main, NULL);
+}
+
+static void async_init(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, async_start);
+}
+
+static void async_wake(void)
+{
+    sem_post(&async_queue.wake);
+}
+
+static void async_join(void)
+{
+    pthread_join(async_queue.thread, NULL);
+    sem_destroy(&async_queue.wake);
+}
+
+static void async_yield(void)
+{
+    sched_yield();
+}
+#endif
+
+int MEMAPI memcpy_test(memcpy_handle handle)
+{
+    return __atomic_load_n(&async_queue.completed, __ATOMIC_ACQUIRE) >= handle;
+}
+
+void MEMAPI memcpy_wait(memcpy_handle handle)
+{
+    for (int spins = 0; !memcpy_test(handle);)
+    {
+        if (++spins < ASYNC_SPIN)
+            CPU_PAUSE();
+        else
+            async_yield();
+    }
+}
+
+void MEMAPI memcpy_async_shutdown(void)
+{
+    const uint64_t tail = __atomic_fetch_or(&async_queue.tail, ASYNC_CLOSED, __ATOMIC_SEQ_CST);
+    if (tail & ASYNC_CLOSED)
+        return;
+    /* a start already under way finishes first, and none begins after the close */
+    async_init();
+    if (!async_queue.started)
+        return;
+    memcpy_wait(tail);
+    __atomic_store_n(&async_queue.stop, 1, __ATOMIC_SEQ_CST);
+    async_wake();
+    async_join();
+}
+
+/* stops the copy thread before the library goes away (dlclose or exit), after the queue drains.
+ * Not on Windows: DLL_PROCESS_DETACH runs under the loader lock, which a thread needs to exit,
+ * and at process exit the thread is gone already; the module reference keeps FreeLibrary() from
+ * getting there before memcpy_async_shutdown() */
+#ifndef _WIN32
+__attribute__((destructor)) static void async_shutdown(void)
+{
+    memcpy_async_shutdown();
+}
+#endif
+
+/* a copy run by the caller, after the ones queued ahead of it */
+static memcpy_handle async_inline(void *dst, const void *src, size_t n, uint64_t ticket)
+{
+    ticket &= ~ASYNC_CLOSED;
+    memcpy_wait(ticket);
+    copy_disjoint(dst, src, n);
+    return ticket;
+}
+
+NOBUILTIN NOINLINE
+memcpy_handle MEMAPI memcpy_async(void *dst, const void *src, size_t n)
+{
+    uint64_t ticket = __atomic_load_n(&async_queue.tail, __ATOMIC_RELAXED);
+
+    /* small copies with nothing queued ahead to keep them in order with */
+    if (n <= ASYNC_INLINE_MAX && __atomic_load_n(&async_queue.completed, __ATOMIC_ACQUIRE) == ticket)
+    {
+        copy_disjoint(dst, src, n);
+        return ticket;
+    }
+
+    async_init();
+    if (unlikely(!async_queue.started))
+        return async_inline(dst, src, n, ticket);
+
+    struct async_slot *slot;
+    for (int spins = 0;;)
+    {
+        /* closed: the claimed tickets drain, and this copy goes after them */
+        if (unlikely(ticket & ASYNC_CLOSED))
+            return async_inline(dst, src, n, ticket);
+        slot = &async_queue.slots[ticket & (ASYNC_RING_SIZE - 1)];
+        const int64_t turn = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - ticket);
+        if (turn == 0)
+        {
+            if (__atomic_compare_exchange_n(&async_queue.tail, &ticket, ticket + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if (turn < 0) /* full: the copy thread still owns this slot */
+        {
+            if (++spins < ASYNC_SPIN)
+                CPU_PAUSE();
+            else
+                async_yield();
+            ticket = __atomic_load_n(&async_queue.tail, __ATOMIC_RELAXED);
+        }
+        else
+            ticket = __atomic_load_n(&async_queue.tail, __ATOMIC_RELAXED);
+    }
+
+    slot->dst = dst;
+    slot->src = src;
+    slot->n = n;
+    __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&async_queue.sleeping, 0, __ATOMIC_SEQ_CST))
+        async_wake();
+    return ticket + 1;
+}
+
+/* the page tables for n bytes at p filled in with one call instead of a fault per page;
+ * 0 where that is not supported, and the copy takes the faults as usual */
+static int prefault_range(void *p, size_t n)
+{
+#ifdef _WIN32
+    (void)p, (void)n;
+    return 0;
+#else
+    /* madvise() wants a start on a page boundary, which is not 4 KiB everywhere */
+    const uintptr_t page = membase_page_size();
+    const uintptr_t start = (uintptr_t)p & ~(page - 1);
+    const uintptr_t end = ((uintptr_t)p + n + page - 1) & ~(page - 1);
+    return !madvise((void *)start, end - start, MADV_POPULATE_WRITE);
+#endif
+}
+
+/* chunks end on PREFAULT_CHUNK boundaries of dst, so no page is populated twice */
+NOBUILTIN NOINLINE
+void MEMAPI *memcpy_prefault(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    const int stream = n >= STREAMING_THRESHOLD;
+    /* a few faults cost less than the system call */
+    int populate = n >= PREFAULT_CHUNK;
+
+    while (n)
+    {
+        size_t chunk = PREFAULT_CHUNK - ((uintptr_t)d & (PREFAULT_CHUNK - 1));
+        chunk = chunk < n ? chunk : n;
+
+        if (populate)
+            populate = prefault_range(d, chunk);
+        if (stream)
+            memop_dispatch_stream(d, s, chunk);
+        else
+            copy_disjoint(d, s, chunk);
+
+        d += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+    return dst;
 }
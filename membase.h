@@ -58,8 +58,97 @@
 #define MEMAPI __attribute__((visibility("default")))
 #endif
 
-#if defined(_WIN32) || !__has_builtin(__builtin_cpu_supports)
+#define CACHE_LINE_SIZE 64
+
+#ifdef __aarch64__
+/* declared here rather than from <sys/auxv.h>, like __cpuidex below */
+unsigned long getauxval(unsigned long type);
+#ifndef AT_PAGESZ
+#define AT_PAGESZ 6
+#endif
+#ifndef AT_HWCAP
+#define AT_HWCAP 16
+#endif
+
+/* single AT_HWCAP bits, for what the tiers of cpu_supports() don't cover */
+#define CPU_FEATURE_ASIMD 1
+#define CPU_FEATURE_DCPOP 16
+#define CPU_FEATURE_SVE 22
+
+static inline int cpu_has_feature(const int feature)
+{
+    static unsigned long hwcap;
+    static int initialized;
+    if (unlikely(!initialized))
+    {
+        hwcap = getauxval(AT_HWCAP);
+        initialized = 1;
+    }
+    return !!(hwcap & (1UL << feature));
+}
 
+/* the cache maintenance ops by their sys encodings, which assemble for any armv8 target:
+ * dc cvap (clean to the point of persistence, armv8.2), dc cvac and dc civac (clean, and
+ * clean and invalidate, to the point of coherency) */
+static inline void writeback_line_cvap(const void *p)
+{
+    __asm__ __volatile__("sys #3, c7, c12, #1, %0" : : "r"(p) : "memory");
+}
+
+static inline void writeback_line_cvac(const void *p)
+{
+    __asm__ __volatile__("sys #3, c7, c10, #1, %0" : : "r"(p) : "memory");
+}
+
+static inline void writeback_line_civac(const void *p)
+{
+    __asm__ __volatile__("sys #3, c7, c14, #1, %0" : : "r"(p) : "memory");
+}
+
+/* writes every cache line overlapping the n bytes at p back to memory, ordered by the next
+ * cpu_persist_fence(): to the point of persistence where the cpu has one, else of coherency */
+static inline void cpu_writeback(const void *p, size_t n)
+{
+    if (unlikely(!n)) /* else the line holding an unaligned p would be written back */
+        return;
+
+    const char *line = (const char *)((uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    const char *end = (const char *)p + n;
+
+    if (cpu_has_feature(CPU_FEATURE_DCPOP))
+    {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            writeback_line_cvap(line);
+    }
+    else
+    {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            writeback_line_cvac(line);
+    }
+}
+
+/* waits for cpu_writeback() and the stores before it to complete */
+static inline void cpu_persist_fence(void)
+{
+    __asm__ __volatile__("dsb sy" : : : "memory");
+}
+
+#define FEAT_SVE 2
+#define FEAT_NEON 1
+
+static inline int cpu_supports(const int featurelevel)
+{
+    static int cpu_featurelevel = -1;
+    if (unlikely(cpu_featurelevel < 0))
+    {
+        cpu_featurelevel = 0;
+        if (cpu_has_feature(CPU_FEATURE_ASIMD))
+            cpu_featurelevel = cpu_has_feature(CPU_FEATURE_SVE) ? FEAT_SVE : FEAT_NEON;
+    }
+    return (cpu_featurelevel >= featurelevel);
+}
+
+#else
 #if !__has_builtin(__cpuidex)
 #if defined(_MSC_VER) && !defined(__clang__)
 void __cpuidex(int info[4], int ax, int cx);
@@ -78,7 +167,87 @@ void __cpuid(int info[4], int ax);
 #endif
 #endif
 
-#endif
+/* single feature bits from cpuid leaf 7, for what the tiers of cpu_supports() don't cover */
+#define CPUID7_EBX(bit) (bit)
+#define CPUID7_ECX(bit) (32 + (bit))
+
+#define CPU_FEATURE_CLFLUSHOPT CPUID7_EBX(23)
+#define CPU_FEATURE_CLWB CPUID7_EBX(24)
+#define CPU_FEATURE_AVX512BW CPUID7_EBX(30)
+#define CPU_FEATURE_AVX512VL CPUID7_EBX(31)
+#define CPU_FEATURE_CLDEMOTE CPUID7_ECX(25)
+
+static inline int cpu_has_feature(const int feature)
+{
+    static uint64_t leaf7_bits;
+    static int initialized;
+    if (unlikely(!initialized))
+    {
+        int regs[4];
+
+        __cpuid(regs, 0);
+        if (regs[0] >= 7)
+        {
+            __cpuidex(regs, 7, 0);
+            leaf7_bits = (uint32_t)regs[1] | ((uint64_t)(uint32_t)regs[2] << 32);
+        }
+        initialized = 1;
+    }
+    return !!(leaf7_bits & (1ULL << feature));
+}
+
+__attribute__((target("clwb"))) static inline void writeback_line_clwb(const void *p)
+{
+    __builtin_ia32_clwb(p);
+}
+
+__attribute__((target("clflushopt"))) static inline void writeback_line_clflushopt(const void *p)
+{
+    __builtin_ia32_clflushopt(p);
+}
+
+__attribute__((target("sse2"))) static inline void writeback_line_clflush(const void *p)
+{
+    __builtin_ia32_clflush(p);
+}
+
+/* writes every cache line overlapping the n bytes at p back to memory, ordered by the next sfence:
+ * clwb where there is one, since the line may stay cached, then clflushopt, then plain clflush */
+static inline void cpu_writeback(const void *p, size_t n)
+{
+    if (unlikely(!n)) /* else the line holding an unaligned p would be written back */
+        return;
+
+    const char *line = (const char *)((uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    const char *end = (const char *)p + n;
+
+    if (cpu_has_feature(CPU_FEATURE_CLWB))
+    {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            writeback_line_clwb(line);
+    }
+    else if (cpu_has_feature(CPU_FEATURE_CLFLUSHOPT))
+    {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            writeback_line_clflushopt(line);
+    }
+    else
+    {
+        for (; line < end; line += CACHE_LINE_SIZE)
+            writeback_line_clflush(line);
+    }
+}
+
+/* waits for cpu_writeback() and the non-temporal stores before it to reach memory */
+static inline void cpu_persist_fence(void)
+{
+    __asm__ __volatile__("sfence" : : : "memory");
+}
+
+#define FEAT_AVX512VL 4
+#define FEAT_AVX512 3
+#define FEAT_AVX2 2
+#define FEAT_SSE2 1
 
 static inline int cpu_supports(const int featurelevel)
 {
@@ -97,15 +266,196 @@ static inline int cpu_supports(const int featurelevel)
         const int ecx_features = regs[2];
         const int ebx_features = extended_regs[1];
 
-        cpu_featurelevel += !!(edx_features & (1 << 26)) + (ecx_features & (1 << 28)) && (ebx_features & (1 << 5)) + !!(ebx_features & (1 << 16));
+        /* sse2, avx with avx2, avx512f: one level each */
+        cpu_featurelevel += !!(edx_features & (1 << 26)) +
+                            ((ecx_features & (1 << 28)) && (ebx_features & (1 << 5))) +
+                            !!(ebx_features & (1 << 16));
 #else
         cpu_featurelevel += __builtin_cpu_supports("avx512f") + __builtin_cpu_supports("avx2") + __builtin_cpu_supports("sse2");
 #endif
+        /* the 256-bit masked tier wants VL and BW on top of AVX-512F */
+        if (cpu_featurelevel == FEAT_AVX512 && cpu_has_feature(CPU_FEATURE_AVX512VL) &&
+            cpu_has_feature(CPU_FEATURE_AVX512BW))
+            cpu_featurelevel++;
     }
     return (cpu_featurelevel >= featurelevel);
 }
 
+#endif
+
+/* the system's page size: 4 KiB on x86, but 16 or 64 KiB on some aarch64 kernels, so
+ * looked up there once */
+static inline size_t membase_page_size(void)
+{
+#ifdef __aarch64__
+    static size_t size;
+    if (unlikely(!size))
+        size = (size_t)getauxval(AT_PAGESZ);
+    return size;
+#else
+    return 4096;
+#endif
+}
+
+/* memop_avx512_policy() values: full 512-bit vectors, or 256-bit ones with AVX-512VL masked
+ * tails where 512-bit instructions would lower the clock for everything else on the core */
+#define AVX512_POLICY_ZMM 0
+#define AVX512_POLICY_YMM 1
+
+/* memcpy_hint() flags, about what happens to either buffer after the copy; conflicting
+ * KEEP and STREAM/NTA hints for the same buffer resolve to KEEP */
+#define MEMCPY_HINT_KEEP_SRC 0x01   /* read again soon: cached loads (the default) */
+#define MEMCPY_HINT_KEEP_DST 0x02   /* read next by this core: cached stores at any size */
+#define MEMCPY_HINT_STREAM_DST 0x04 /* not read for a while: non-temporal stores at any size */
+#define MEMCPY_HINT_NTA_SRC 0x08    /* not read again: prefetchnta ahead of the loads */
+#define MEMCPY_HINT_DEMOTE_DST 0x10 /* read next by another core: cldemote after the copy, where there is one */
+
+/* memcpy_sparse() goes by the destination's pages, of the system's page size:
+ * MEMCPY_SPARSE_PAGES(dst, n) of them, the first and last possibly partial */
+#define MEMCPY_SPARSE_PAGE_SIZE membase_page_size()
+#define MEMCPY_SPARSE_PAGES(dst, n) \
+    ((n) ? ((uintptr_t)(dst) % MEMCPY_SPARSE_PAGE_SIZE + (n) - 1) / MEMCPY_SPARSE_PAGE_SIZE + 1 : 0)
+
+/* memcpy_delta() reports by the destination's cache lines, MEMCPY_DELTA_LINES(dst, n) of them */
+#define MEMCPY_DELTA_LINES(dst, n) \
+    ((n) ? ((uintptr_t)(dst) % CACHE_LINE_SIZE + (n) - 1) / CACHE_LINE_SIZE + 1 : 0)
+
+/* memcpy_async() tickets; every copy is done once one issued after it is, and 0 never waits */
+typedef uint64_t memcpy_handle;
+
+/* membase_stats_snapshot() size classes: bucket b holds the n that are b bits long,
+ * so 0 in bucket 0, 1 in bucket 1, 2-3 in bucket 2, 4-7 in bucket 3 and so on */
+#define MEMBASE_STATS_BUCKETS 65
+
+enum membase_tier
+{
+    MEMBASE_TIER_SCALAR,
+#ifdef __aarch64__
+    MEMBASE_TIER_NEON,
+    MEMBASE_TIER_SVE,
+#else
+    MEMBASE_TIER_SSE2,
+    MEMBASE_TIER_AVX2,
+    MEMBASE_TIER_AVX512,
+    MEMBASE_TIER_AVX512VL,
+#endif
+    MEMBASE_TIER_COUNT
+};
+
+/* totals over every thread since the library was loaded, in a build with -DMEMBASE_STATS */
+struct membase_stats
+{
+    /* memcpy_local() and memmove_local() calls by the bit length of n */
+    uint64_t calls[MEMBASE_STATS_BUCKETS];
+    uint64_t bytes[MEMBASE_STATS_BUCKETS];
+    uint64_t cycles[MEMBASE_STATS_BUCKETS]; /* TSC (or generic timer) ticks inside those calls, with -DMEMBASE_STATS_CYCLES */
+
+    /* runs of the copy kernels, from every entry point that uses them */
+    uint64_t tiers[MEMBASE_TIER_COUNT];
+    uint64_t cached, cached_bytes;       /* ordinary stores */
+    uint64_t streaming, streaming_bytes; /* non-temporal stores */
+    uint64_t alias_reversed;             /* disjoint copies run backward to get away from 4K aliasing */
+
+    /* how memmove_local() got its calls done */
+    uint64_t memmove_same;     /* dst == src, nothing to do */
+    uint64_t memmove_disjoint; /* plain memcpy */
+    uint64_t memmove_forward;  /* overlapping with dst below src */
+    uint64_t memmove_backward; /* and above */
+    uint64_t memmove_split;    /* backward ones far enough apart to go in disjoint chunks */
+    uint64_t memmove_ahead;    /* overlaps close to 4K aliasing, with the loads a group ahead */
+};
+
+/* direction 0 copies forward, anything else backward from the end */
+typedef void *(*memop_fn)(void *dst, const void *src, size_t n, int direction);
+
+struct memop_engine
+{
+    const char *name;
+    memop_fn fn;
+    int feature;
+    int dispatch; /* nonzero for the unroll and schedule memcpy_local uses on this tier */
+};
+
 #ifndef SHARED
 NOINLINE void MEMAPI *memcpy_local(void *dst, const void *src, size_t n);
 NOINLINE void MEMAPI *memmove_local(void *dst, const void *src, size_t n);
+const struct memop_engine MEMAPI *memop_engines(size_t *count);
+int MEMAPI memop_avx512_policy(int policy);
+/* fills stats and returns nonzero in a MEMBASE_STATS build; zeroes them and returns 0 otherwise */
+int MEMAPI membase_stats_snapshot(struct membase_stats *stats);
+/* size in bytes of the data/unified cache at the given level (1-3), or of the last level cache for 0 */
+size_t MEMAPI membase_cache_size(int level);
+
+/* width bytes from each of height rows, rows pitch bytes apart; src and dst must not overlap */
+NOINLINE void MEMAPI *memcpy2d(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height);
+/* depth slices of memcpy2d, slices slice bytes apart */
+NOINLINE void MEMAPI *memcpy3d(void *dst, size_t dpitch, size_t dslice, const void *src, size_t spitch, size_t sslice,
+                               size_t width, size_t height, size_t depth);
+
+/* n bytes, byte swapping each whole 16/32/64-bit element on the way; a trailing partial
+ * element is copied as is. dst may equal src, but must not otherwise overlap it */
+NOINLINE void MEMAPI *memcpy_bswap16(void *dst, const void *src, size_t n);
+NOINLINE void MEMAPI *memcpy_bswap32(void *dst, const void *src, size_t n);
+NOINLINE void MEMAPI *memcpy_bswap64(void *dst, const void *src, size_t n);
+
+/* like the libc functions; the vector paths read whole aligned vectors around the
+ * string, but never past the page holding its terminator (or the match) */
+NOINLINE void MEMAPI *memchr_local(const void *s, int c, size_t n);
+NOINLINE void MEMAPI *memrchr_local(const void *s, int c, size_t n);
+NOINLINE size_t MEMAPI strlen_local(const char *s);
+NOINLINE size_t MEMAPI strnlen_local(const char *s, size_t maxlen);
+
+/* n bytes from src, then fill up to total bytes (a fixed size record) in the same
+ * pass; n past total is cut to total. src and dst must not overlap */
+NOINLINE void MEMAPI *memcpy_pad(void *dst, const void *src, size_t n, size_t total, int fill);
+/* like the libc functions, reading src as the scanners above do; strings must not overlap */
+NOINLINE char MEMAPI *stpcpy_local(char *dst, const char *src);
+NOINLINE char MEMAPI *stpncpy_local(char *dst, const char *src, size_t n);
+NOINLINE size_t MEMAPI strlcpy_local(char *dst, const char *src, size_t size);
+
+/* n bytes made durable on persistent memory (e.g. a DAX mapping) by the time it returns:
+ * whole lines with non-temporal stores, partial ones written back, then one fence */
+NOINLINE void MEMAPI *memcpy_persist(void *dst, const void *src, size_t n);
+/* memcpy that stores only the cache lines of dst that differ from src, leaving the rest clean
+ * (and unwritten, even to read-only pages); returns how many bytes differed. Of the
+ * MEMCPY_DELTA_LINES(dst, n) lines dst spans, the first and last possibly partial, line i sets
+ * bit i % 64 of dirty_lines[i / 64] if it was stored to (and clears it otherwise) unless
+ * dirty_lines is NULL. src and dst must not overlap */
+NOINLINE size_t MEMAPI memcpy_delta(void *dst, const void *src, size_t n, uint64_t *dirty_lines);
+/* memcpy that leaves out every destination page whose source bytes are all zero: those are not
+ * written at all, so the caller can leave them be, drop them (MADV_DONTNEED) or clear them. Page i
+ * sets bit i % 64 of zero_pages[i / 64] (and clears it otherwise) unless zero_pages is NULL; returns
+ * how many were left out. src and dst must not overlap */
+NOINLINE size_t MEMAPI memcpy_sparse(void *dst, const void *src, size_t n, uint64_t *zero_pages);
+/* the n bytes at a and b exchanged, through vector registers rather than a buffer; a may equal
+ * b, but must not otherwise overlap it */
+NOINLINE void MEMAPI memswap_local(void *a, void *b, size_t n);
+/* the n bytes at buf rotated in place, so that the byte at shift (taken modulo n) comes first,
+ * as std::rotate does; no allocation, and at most a few hundred bytes of stack */
+NOINLINE void MEMAPI *memrotate_local(void *buf, size_t n, size_t shift);
+/* memcpy_local behind a straight line copy for each (size, alignment) pair of the profile the
+ * library was built with ("make PROFILE=..."), the most frequent first; without one it is memcpy_local */
+NOINLINE void MEMAPI *memcpy_profiled(void *dst, const void *src, size_t n);
+/* count records of size bytes copied by index: memcpy_gather takes record idx[i] of src to
+ * record i of dst, memcpy_scatter record i of src to record idx[i] of dst, the last one winning
+ * where indices repeat; no two records may overlap */
+NOINLINE void MEMAPI *memcpy_gather(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size);
+NOINLINE void MEMAPI *memcpy_scatter(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size);
+/* memcpy with MEMCPY_HINT_* flags choosing the engine; src and dst must not overlap */
+NOINLINE void MEMAPI *memcpy_hint(void *dst, const void *src, size_t n, int flags);
+/* memcpy into memory that may not have been touched yet: the destination's pages are
+ * populated a chunk at a time just ahead of the copy (MADV_POPULATE_WRITE) instead of faulting one by one */
+NOINLINE void MEMAPI *memcpy_prefault(void *dst, const void *src, size_t n);
+
+/* n bytes copied by a background thread with streaming stores, in submission order, so
+ * later copies into the same dst land after earlier ones; neither buffer may be touched
+ * until memcpy_wait() returns or memcpy_test() gives nonzero for the handle */
+NOINLINE memcpy_handle MEMAPI memcpy_async(void *dst, const void *src, size_t n);
+void MEMAPI memcpy_wait(memcpy_handle handle);
+int MEMAPI memcpy_test(memcpy_handle handle);
+/* waits for every queued copy and stops the copy thread, after which memcpy_async() copies
+ * before returning; needed before FreeLibrary() on Windows, done by dlclose() and exit elsewhere.
+ * A memcpy_async() racing with it either queues before and is done by the time it returns, or
+ * copies inline itself */
+void MEMAPI memcpy_async_shutdown(void);
 #endif
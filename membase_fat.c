@@ -0,0 +1,117 @@
+/*
+ * load time selection between builds of membase.c for each x86-64 psABI level
+ *
+ * Copyright (C) 2025 William Horvath
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* "make fat" links this with membase.c built once per level, each object's exported names
+ * suffixed _v1 to _v4, and every export of the library becomes an ifunc here that the dynamic
+ * loader resolves to one of them. Only one level is ever called, so its statics (the async
+ * queue, the AVX-512 policy, the stats) are the only ones in use. */
+
+#if !defined(__x86_64__) || !defined(__ELF__)
+#error The fat library needs x86-64 and ELF ifuncs.
+#endif
+
+/* every function membase.h declares */
+#define MEMBASE_EXPORTS(X)    \
+    X(memcpy_local)           \
+    X(memmove_local)          \
+    X(memop_engines)          \
+    X(memop_avx512_policy)    \
+    X(membase_stats_snapshot) \
+    X(membase_cache_size)     \
+    X(memcpy2d)               \
+    X(memcpy3d)               \
+    X(memcpy_bswap16)         \
+    X(memcpy_bswap32)         \
+    X(memcpy_bswap64)         \
+    X(memchr_local)           \
+    X(memrchr_local)          \
+    X(strlen_local)           \
+    X(strnlen_local)          \
+    X(memcpy_pad)             \
+    X(stpcpy_local)           \
+    X(stpncpy_local)          \
+    X(strlcpy_local)          \
+    X(memcpy_persist)         \
+    X(memcpy_delta)           \
+    X(memcpy_sparse)          \
+    X(memswap_local)          \
+    X(memrotate_local)        \
+    X(memcpy_profiled)        \
+    X(memcpy_gather)          \
+    X(memcpy_scatter)         \
+    X(memcpy_hint)            \
+    X(memcpy_prefault)        \
+    X(memcpy_async)           \
+    X(memcpy_wait)            \
+    X(memcpy_test)            \
+    X(memcpy_async_shutdown)
+
+/* the highest level this cpu (and OS, for the vector state) has every feature of; the levels'
+ * smaller extras (cx16, lahf, movbe, f16c, lzcnt...) come with the ones checked on any real part */
+static int cpu_level(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512dq") &&
+        __builtin_cpu_supports("avx512vl"))
+        return 4;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2") &&
+        __builtin_cpu_supports("fma"))
+        return 3;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt") && __builtin_cpu_supports("ssse3"))
+        return 2;
+    return 1;
+}
+
+typedef void (*any_fn)(void);
+
+/* hidden, so that the resolvers reach them without relocations the loader may not have done yet */
+#define DECLARE_LEVELS(name)                                           \
+    __attribute__((visibility("hidden"))) extern void name##_v1(void); \
+    __attribute__((visibility("hidden"))) extern void name##_v2(void); \
+    __attribute__((visibility("hidden"))) extern void name##_v3(void); \
+    __attribute__((visibility("hidden"))) extern void name##_v4(void);
+
+#define RESOLVE_LEVEL(name)            \
+    static any_fn resolve_##name(void) \
+    {                                  \
+        switch (cpu_level())           \
+        {                              \
+        case 4:                        \
+            return name##_v4;          \
+        case 3:                        \
+            return name##_v3;          \
+        case 2:                        \
+            return name##_v2;          \
+        default:                       \
+            return name##_v1;          \
+        }                              \
+    }                                  \
+    __attribute__((visibility("default"), ifunc("resolve_" #name))) void name(void);
+
+MEMBASE_EXPORTS(DECLARE_LEVELS)
+MEMBASE_EXPORTS(RESOLVE_LEVEL)
+
+/* which build the loader picked, for membench */
+__attribute__((visibility("default"))) const char *membase_fat_level(void)
+{
+    static const char *const names[] = {"x86-64", "x86-64-v2", "x86-64-v3", "x86-64-v4"};
+    return names[cpu_level() - 1];
+}
@@ -18,31 +18,34 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#define _GNU_SOURCE /* memrchr, stpcpy, stpncpy */
+
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
 #include "membench.h"
+#include "membase.h"
 
-#ifndef SHARED
-void *memcpy_local(void *dst, const void *src, size_t n);
-void *memmove_local(void *dst, const void *src, size_t n);
-#endif
-
-#define ALIGNMENT_HEADER "transfer size : test case       |   best GB/s   worst GB/s   avg GB/s\n"
+#define ALIGNMENT_HEADER "transfer size : test case       | median GB/s   p5 GB/s   p95 GB/s   95% CI\n"
+/* the same columns for the tables in compute Mop/s, whose titles say so */
+#define MOPS_HEADER      "test case                       |      median        p5        p95   95% CI\n"
 #define SEPARATOR        "--------------------------------|------------------------------------\n"
 
 #define DEFAULT_TEST_DURATION_NS (500 * 1000 * 1000) /* 500ms (not even close to accurate) */
 
 typedef void *(*stringop_fn)(void *, const void *, size_t);
 
+#define SUMMARY_MAX_CASES 64
+
+/* the medians of one summary category in the order they ran, so that ours and stdlib's pair up,
+ * each with the standard error of its log from the median's confidence interval; 0 where it failed */
 struct perf_stats
 {
-    double total_gb;
-    double count;
-    double min_gb;
-    double max_gb;
+    double median_gbs[SUMMARY_MAX_CASES];
+    double log_se[SUMMARY_MAX_CASES];
+    size_t count;
 };
 
 struct test_results
@@ -54,6 +57,25 @@ struct test_results
     size_t total_tests;
 };
 
+/* one measurement: percentiles of its samples and the 95% confidence interval of their median */
+struct sample_stats
+{
+    double median;
+    double p5;
+    double p95;
+    double ci_low;
+    double ci_high;
+    int count;
+    int drift; /* the reference loop ran at a different speed afterwards, so the clock moved under it */
+};
+
+enum test_kind
+{
+    TEST_MEMCPY,
+    TEST_MEMMOVE,
+    TEST_ALIAS_SWEEP,
+};
+
 struct test_case
 {
     const char *name;
@@ -72,88 +94,356 @@ struct test_case
     };
 };
 
-struct lib_functions
+#define MAX_IMPLEMENTATIONS 32
+
+/* one entry of the registry; the first two are always ours and the C library's */
+struct implementation
 {
-    stringop_fn memcpy_fn;
-    stringop_fn memmove_fn;
     const char *name;
+    stringop_fn memcpy_fn;
+    stringop_fn memmove_fn; /* NULL when it can't take overlaps, which leaves it out of the memmove table */
     struct test_results results;
-    dl_handle handle;
+    dl_handle handle; /* for --impl=path:symbol */
 };
 
-static struct lib_functions implementations[2] = {
+static struct implementation implementations[MAX_IMPLEMENTATIONS];
+static size_t num_implementations;
+/* what the "vs" column compares against, from --baseline= */
+static size_t baseline = 1;
+
+#ifdef SHARED
+static dl_handle memlib_handle;
+static dl_handle stdlib_handle;
+
+static void *load_symbol(dl_handle *handle, const char *lib, const char *lib_fb, const char *symbol)
+{
+    if (!*handle)
+        *handle = dlopen(lib, RTLD_NOW);
+    if (!*handle)
+        *handle = dlopen(lib_fb, RTLD_NOW);
+    if (!*handle)
+    {
+        printf("failed to load %s\n", lib_fb);
+        exit(1);
+    }
+    return dlsym(*handle, symbol);
+}
+
+/* extra entry points that only our library has */
+static void *load_memlib_symbol(const char *symbol)
+{
+    void *ptr = load_symbol(&memlib_handle, memlib, memlib, symbol);
+    if (!ptr)
+    {
+        printf("failed to load %s from %s\n", symbol, memlib);
+        exit(1);
+    }
+    return ptr;
+}
+
+/* baselines beyond memcpy/memmove, which not every libc has */
+static void *load_stdlib_symbol(const char *symbol)
+{
+    return load_symbol(&stdlib_handle, stdlib, stdlib_fb, symbol);
+}
+
+static void cleanup_libs(void)
+{
+    if (memlib_handle)
+    {
+        dlclose(memlib_handle);
+        memlib_handle = NULL;
+    }
+    if (stdlib_handle)
     {
-#ifndef SHARED
-        .memcpy_fn = memcpy_local, .memmove_fn = memmove_local,
+        dlclose(stdlib_handle);
+        stdlib_handle = NULL;
+    }
+}
+
+#define MEMLIB_FN(type, name) ((union { void *ptr; type fn; }){load_memlib_symbol(#name)}.fn)
+#define STDLIB_FN(type, name) ((union { void *ptr; type fn; }){load_stdlib_symbol(#name)}.fn)
+#else
+#define MEMLIB_FN(type, name) (name)
+#define STDLIB_FN(type, name) (name)
 #endif
-        .name = "our", .results = {0}, .handle = NULL},
+
+static struct implementation *add_implementation(const char *name, stringop_fn memcpy_fn, stringop_fn memmove_fn)
+{
+    if (num_implementations >= MAX_IMPLEMENTATIONS)
     {
-#ifndef SHARED
-        .memcpy_fn = memcpy, .memmove_fn = memmove,
+        printf("too many implementations, at most %d.\n", MAX_IMPLEMENTATIONS);
+        exit(1);
+    }
+    if (!memcpy_fn)
+    {
+        printf("no memcpy for %s\n", name);
+        exit(1);
+    }
+
+    struct implementation *impl = &implementations[num_implementations++];
+    *impl = (struct implementation){.name = name, .memcpy_fn = memcpy_fn, .memmove_fn = memmove_fn};
+    return impl;
+}
+
+#ifndef __aarch64__
+/* rep movsb, backward with the direction flag set where an overlap needs it */
+static void *copy_rep_movsb(void *dst, const void *src, size_t n)
+{
+    void *d = dst;
+    __asm__ __volatile__("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+    return dst;
+}
+
+static void *move_rep_movsb(void *dst, const void *src, size_t n)
+{
+    if ((uintptr_t)dst - (uintptr_t)src >= n)
+        return copy_rep_movsb(dst, src, n);
+
+    void *d = (char *)dst + n - 1;
+    const void *s = (const char *)src + n - 1;
+    __asm__ __volatile__("std\n\trep movsb\n\tcld" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+    return dst;
+}
 #endif
-        .name = "stdlib", .results = {0}, .handle = NULL}};
 
-#ifdef SHARED
-static void load_functions(struct lib_functions *impl)
+/* one byte at a time, as a compiler would be told not to improve on */
+NOBUILTIN static void *copy_bytes(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+#pragma clang loop vectorize(disable) interleave(disable)
+    for (size_t i = 0; i < n; i++)
+        d[i] = s[i];
+    return dst;
+}
+
+NOBUILTIN static void *move_bytes(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+
+    if ((uintptr_t)dst - (uintptr_t)src >= n)
+        return copy_bytes(dst, src, n);
+#pragma clang loop vectorize(disable) interleave(disable)
+    for (size_t i = n; i > 0; i--)
+        d[i - 1] = s[i - 1];
+    return dst;
+}
+
+typedef const struct memop_engine *(*memop_engines_fn)(size_t *count);
+
+/* the engines behind each tier of the dispatcher, called directly; one slot each, since a
+ * stringop_fn has nowhere to carry the engine */
+static memop_fn tier_engines[5];
+
+#define TIER_WRAPPERS(i)                                                              \
+    static void *tier_copy_##i(void *dst, const void *src, size_t n)                 \
+    {                                                                                 \
+        return tier_engines[i](dst, src, n, 0);                                       \
+    }                                                                                 \
+    static void *tier_move_##i(void *dst, const void *src, size_t n)                 \
+    {                                                                                 \
+        return tier_engines[i](dst, src, n, (uintptr_t)dst - (uintptr_t)src < n);    \
+    }
+
+TIER_WRAPPERS(0)
+TIER_WRAPPERS(1)
+TIER_WRAPPERS(2)
+#ifndef __aarch64__
+TIER_WRAPPERS(3)
+TIER_WRAPPERS(4)
+#endif
+
+/* each tier runs the engine memop_engines() flags as the dispatchers' own; the grid table has the rest */
+static const struct
+{
+    const char *name;
+    stringop_fn copy;
+    stringop_fn move;
+} builtin_tiers[] = {
+#ifdef __aarch64__
+    {"sve", tier_copy_0, tier_move_0},
+    {"neon", tier_copy_1, tier_move_1},
+    {"scalar", tier_copy_2, tier_move_2},
+#else
+    {"avx512", tier_copy_0, tier_move_0},
+    {"avx512vl", tier_copy_1, tier_move_1},
+    {"avx2", tier_copy_2, tier_move_2},
+    {"sse2", tier_copy_3, tier_move_3},
+    {"scalar", tier_copy_4, tier_move_4},
+#endif
+};
+
+/* whether an engine name ("avx2 x4 interleaved", or just "scalar") is one of tier's */
+static int engine_of_tier(const char *engine, const char *tier)
 {
+    const size_t len = strlen(tier);
+    return !strncmp(engine, tier, len) && (engine[len] == ' ' || !engine[len]);
+}
 
-    const char *lib, *lib_fb, *memcpy_fn, *memmove_fn;
-    if (strncmp(impl->name, "stdlib", strlen(impl->name)))
+#if defined(compactlib) || defined(fatlib)
+/* memcpy_local and memmove_local from another build of our library, "make compact" or "make fat" */
+static struct implementation *register_build(const char *name, const char *path)
+{
+    dl_handle handle = dlopen(path, RTLD_NOW);
+    if (!handle)
     {
-        lib = stdlib;
-        lib_fb = stdlib_fb;
+        printf("failed to load %s, build it with make %s.\n", path, name);
+        exit(1);
+    }
 
-        memcpy_fn = "memcpy";
-        memmove_fn = "memmove";
+    union
+    {
+        void *ptr;
+        stringop_fn fn;
+    } copy = {dlsym(handle, "memcpy_local")}, move = {dlsym(handle, "memmove_local")};
+    if (!copy.fn || !move.fn)
+    {
+        printf("failed to load the functions from %s\n", path);
+        exit(1);
     }
-    else
+    struct implementation *impl = add_implementation(name, copy.fn, move.fn);
+    impl->handle = handle;
+    return impl;
+}
+#endif
+
+#ifdef fatlib
+/* the fat library goes by the psABI level its loader picked */
+static void register_fat(void)
+{
+    static char name[64];
+    typedef const char *(*level_fn)(void);
+    struct implementation *impl = register_build("fat", fatlib);
+
+    union
     {
-        lib = memlib;
-        lib_fb = memlib;
+        void *ptr;
+        level_fn fn;
+    } level = {dlsym(impl->handle, "membase_fat_level")};
+    if (level.fn)
+    {
+        snprintf(name, sizeof(name), "fat (%s)", level.fn());
+        impl->name = name;
+    }
+}
+#endif
 
-        memcpy_fn = "memcpy_local";
-        memmove_fn = "memmove_local";
+/* a built-in by name (a tier, "movsb", "bytes", "compact" or "fat"), or path:symbol[:memmove symbol]
+ * from any library, which goes by its symbols in the tables */
+static void register_implementation(const char *spec)
+{
+#ifdef compactlib
+    if (strcmp(spec, "compact") == 0)
+    {
+        register_build(spec, compactlib);
+        return;
+    }
+#endif
+#ifdef fatlib
+    if (strcmp(spec, "fat") == 0)
+    {
+        register_fat();
+        return;
+    }
+#endif
+#ifndef __aarch64__
+    if (strcmp(spec, "movsb") == 0)
+    {
+        add_implementation(spec, copy_rep_movsb, move_rep_movsb);
+        return;
     }
+#endif
+    if (strcmp(spec, "bytes") == 0)
+    {
+        add_implementation(spec, copy_bytes, move_bytes);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(builtin_tiers) / sizeof(builtin_tiers[0]); i++)
+    {
+        if (strcmp(spec, builtin_tiers[i].name))
+            continue;
 
-    impl->handle = dlopen(lib, RTLD_NOW);
-    if (!impl->handle)
-        impl->handle = dlopen(lib_fb, RTLD_NOW);
+        size_t count;
+        const struct memop_engine *engines = MEMLIB_FN(memop_engines_fn, memop_engines)(&count);
+        for (size_t j = 0; j < count; j++)
+        {
+            if (!engines[j].dispatch || !engine_of_tier(engines[j].name, spec))
+                continue;
+            if (!cpu_supports(engines[j].feature))
+            {
+                printf("this cpu can't run the %s tier.\n", spec);
+                exit(1);
+            }
+            tier_engines[i] = engines[j].fn;
+            add_implementation(spec, builtin_tiers[i].copy, builtin_tiers[i].move);
+            return;
+        }
+        printf("no %s engine the dispatchers use in our library.\n", spec);
+        exit(1);
+    }
 
-    if (!impl->handle)
+    /* path:symbol, where the path may start with a drive letter */
+    const char *colon = strchr(spec + (spec[0] && spec[1] == ':' ? 2 : 0), ':');
+    if (!colon || !colon[1])
     {
-        printf("failed to load %s\n", lib_fb);
+        printf("unknown implementation %s, expected a tier, movsb, bytes, compact, fat or path:symbol.\n", spec);
         exit(1);
     }
 
-    void *memcpy_ptr = dlsym(impl->handle, memcpy_fn);
-    void *memmove_ptr = dlsym(impl->handle, memmove_fn);
+    char path[1024], memcpy_name[256], memmove_name[256] = "";
+    const char *second = strchr(colon + 1, ':');
+    snprintf(path, sizeof(path), "%.*s", (int)(colon - spec), spec);
+    snprintf(memcpy_name, sizeof(memcpy_name), "%.*s", (int)(second ? second - colon - 1 : (int)strlen(colon + 1)),
+             colon + 1);
+    if (second)
+        snprintf(memmove_name, sizeof(memmove_name), "%s", second + 1);
 
-    impl->memcpy_fn = *(stringop_fn *)&memcpy_ptr;
-    impl->memmove_fn = *(stringop_fn *)&memmove_ptr;
+    dl_handle handle = dlopen(path, RTLD_NOW);
+    if (!handle)
+    {
+        printf("failed to load %s\n", path);
+        exit(1);
+    }
 
-    if (!impl->memcpy_fn || !impl->memmove_fn)
+    union
+    {
+        void *ptr;
+        stringop_fn fn;
+    } copy = {dlsym(handle, memcpy_name)}, move = {memmove_name[0] ? dlsym(handle, memmove_name) : NULL};
+    if (!copy.fn || (memmove_name[0] && !move.fn))
     {
-        printf("failed to load string function from %s\n", lib_fb);
+        printf("failed to load %s from %s\n", copy.fn ? memmove_name : memcpy_name, path);
         exit(1);
     }
+    add_implementation(colon + 1, copy.fn, move.fn)->handle = handle;
 }
 
-static void cleanup_functions(struct lib_functions *impl)
+/* comma separated table names from --tables=, or NULL for all of them */
+static const char *selected_tables;
+
+static int table_enabled(const char *name)
 {
-    if (impl->handle)
+    if (!selected_tables)
+        return 1;
+
+    size_t len = strlen(name);
+    for (const char *p = selected_tables; p; p = strchr(p, ','))
     {
-        dlclose(impl->handle);
-        impl->handle = NULL;
+        if (*p == ',')
+            p++;
+        if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0'))
+            return 1;
     }
+    return 0;
 }
-#endif
 
 static void init_perf_stats(struct perf_stats *stats)
 {
-    stats->total_gb = 0;
     stats->count = 0;
-    stats->min_gb = 0;
-    stats->max_gb = 0;
 }
 
 static void init_test_results(struct test_results *results)
@@ -165,9 +455,10 @@ static void init_test_results(struct test_results *results)
     results->total_tests = 0;
 }
 
-static void print_measurement(const char *name, double best, double worst, double avg)
+static void print_measurement(const char *name, const struct sample_stats *stats)
 {
-    printf("\n            \t%s\t| %8.2f   %8.2f   %8.2f", name, best, worst, avg);
+    printf("\n            \t%s\t| %11.2f %9.2f %10.2f   +-%.1f%%%s", name, stats->median, stats->p5, stats->p95,
+           (stats->ci_high - stats->ci_low) / 2 / stats->median * 100, stats->drift ? "  (clock drift)" : "");
 }
 
 static void init_test_buffer(unsigned char *buf, size_t size)
@@ -175,185 +466,2689 @@ static void init_test_buffer(unsigned char *buf, size_t size)
     static const unsigned char pattern[] = {
         0x55, 0xAA, 0x33, 0xCC, 0x66, 0x99, 0x0F, 0xF0,
         0xFF, 0x00, 0xA5, 0x5A, 0x3C, 0xC3, 0x69, 0x96};
-    for (size_t i = 0; i < size; i++)
+    for (size_t i = 0; i < size && i < sizeof(pattern); i++)
+    {
+        buf[i] = pattern[i];
+    }
+    /* the rest doubles what is already there */
+    for (size_t done = sizeof(pattern); done < size; done *= 2)
     {
-        buf[i] = pattern[i % sizeof(pattern)];
+        memcpy(buf + done, buf, size - done < done ? size - done : done);
     }
 }
 
-static double measure_throughput(void *dst, const void *src, size_t size, size_t iterations,
-                                 stringop_fn mem_func)
+/* one timed operation; ctx carries whatever it needs */
+typedef void (*bench_fn)(void *ctx);
+
+/* what a timed call reads and writes, first in every sample_op() ctx so that --cache can evict
+ * or move it; spans of 0 mean the bytes the call is counted for */
+struct bench_buffers
 {
-    struct timespec_portable start, end;
+    unsigned char *dst; /* NULL when nothing is written */
+    unsigned char *src;
+    size_t dst_span;
+    size_t src_span;
+};
 
-    init_test_buffer((unsigned char *)src, size);
+enum cache_mode
+{
+    CACHE_HOT,    /* the same buffers every call, so all but the first find them cached */
+    CACHE_COLD,   /* the same buffers, flushed from every cache level before each call */
+    CACHE_ROTATE, /* a pair from a large pool at a random address each call */
+    CACHE_FRESH,  /* dst newly mapped for each call, so the call takes its page faults */
+};
 
-    get_monotonic_time(&start);
+static enum cache_mode cache_mode = CACHE_HOT;
+/* outside hot mode a sample stops after about this long, flushes and all, as the calls run slower
+ * than estimate_iterations() assumes */
+static uint64_t placed_pass_ns;
+
+/* what the process was allowed to run on, before main() pinned it to bench_cpu */
+static bench_affinity process_affinity;
+static int bench_cpu;
+
+/* rotate mode pools, one standing in for the src buffer and one for dst; filled up front so
+ * that no call reads the zero page or takes a fault */
+#define ROTATE_POOL_SIZE (256 * 1024 * 1024)
+#define ROTATE_MAX_SLOTS 4096
+
+static unsigned char *home_src_base;
+static unsigned char *home_dst_base;
+static size_t home_size;
+static unsigned char *pool_src;
+static unsigned char *pool_dst;
+static size_t pool_size;
+static uint64_t rotate_state = 0x9e3779b97f4a7c15ULL;
+
+static size_t buffer_span(size_t span, size_t bytes)
+{
+    return span ? span : bytes;
+}
 
-    for (size_t j = 0; j < iterations; j++)
+static void evict_lines(const unsigned char *p, size_t n)
+{
+#ifdef __aarch64__
+    const uintptr_t end = (uintptr_t)p + n;
+
+    for (uintptr_t line = (uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1); line < end; line += CACHE_LINE_SIZE)
+        writeback_line_civac((const void *)line);
+    __asm__ __volatile__("dsb ish" : : : "memory");
+#else
+    const int opt = cpu_has_feature(CPU_FEATURE_CLFLUSHOPT);
+    const uintptr_t end = (uintptr_t)p + n;
+
+    for (uintptr_t line = (uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1); line < end; line += CACHE_LINE_SIZE)
     {
-        mem_func(dst, src, size);
+        if (opt)
+            writeback_line_clflushopt((const void *)line);
+        else
+            writeback_line_clflush((const void *)line);
     }
+#endif
+}
 
-    get_monotonic_time(&end);
-    double elapsed = timespec_to_seconds(&start, &end);
-    return ((double)size * iterations) / (elapsed * 1e9);
+static void evict_buffers(const struct bench_buffers *buf, size_t bytes)
+{
+    if (buf->src)
+        evict_lines(buf->src, buffer_span(buf->src_span, bytes));
+    if (buf->dst)
+        evict_lines(buf->dst, buffer_span(buf->dst_span, bytes));
 }
 
-static void update_perf_stats(struct perf_stats *stats, double gb_per_sec)
+/* the pool standing in for the buffer p points into, and p's offset in it */
+static unsigned char *pool_for(const unsigned char *p, size_t *offset)
 {
-    stats->total_gb += gb_per_sec;
-    stats->count += 1;
-    if (stats->count == 1 || gb_per_sec < stats->min_gb)
+    if (p >= home_src_base && p < home_src_base + home_size)
     {
-        stats->min_gb = gb_per_sec;
+        *offset = p - home_src_base;
+        return pool_src;
     }
-    if (stats->count == 1 || gb_per_sec > stats->max_gb)
+    if (p >= home_dst_base && p < home_dst_base + home_size)
     {
-        stats->max_gb = gb_per_sec;
+        *offset = p - home_dst_base;
+        return pool_dst;
     }
+    return NULL;
 }
 
-static void run_test_cases(const struct test_case *cases, size_t num_cases,
-                           size_t size, size_t iterations,
-                           unsigned char *src_base, unsigned char *dst_base,
-                           struct lib_functions *impl,
-                           int is_memmove)
+/* as many slots as fit what home touches, spread evenly over the pools in whole pages */
+static size_t rotation_slots(const struct bench_buffers *home, size_t bytes, size_t *stride)
 {
-    printf("\n%s implementation:", impl->name);
+    size_t extent = 0, offset;
+
+    if (home->src && pool_for(home->src, &offset) && offset + buffer_span(home->src_span, bytes) > extent)
+        extent = offset + buffer_span(home->src_span, bytes);
+    if (home->dst && pool_for(home->dst, &offset) && offset + buffer_span(home->dst_span, bytes) > extent)
+        extent = offset + buffer_span(home->dst_span, bytes);
+    extent = (extent + 4095) & ~(size_t)4095;
+
+    size_t slots = extent ? pool_size / extent : 1;
+    slots = slots < 1 ? 1 : slots > ROTATE_MAX_SLOTS ? ROTATE_MAX_SLOTS : slots;
+    *stride = (pool_size / slots) & ~(size_t)4095;
+    return slots;
+}
 
-    for (size_t i = 0; i < num_cases; i++)
-    {
-        const struct test_case *test = &cases[i];
-        unsigned char *src = src_base + (is_memmove ? 64 : test->src_align);
-        unsigned char *dst;
+/* home moved into a slot of the pools; both pointers keep their offsets, and with them their
+ * alignment, page offset and any overlap between the two */
+static void rotate_buffers(struct bench_buffers *buf, const struct bench_buffers *home, size_t slot, size_t stride)
+{
+    unsigned char *pool;
+    size_t offset;
+
+    *buf = *home;
+    if (home->src && (pool = pool_for(home->src, &offset)))
+        buf->src = pool + slot * stride + offset;
+    if (home->dst && (pool = pool_for(home->dst, &offset)))
+        buf->dst = pool + slot * stride + offset;
+}
 
-        if (is_memmove)
-        {
-            dst = test->backwards ? src + test->overlap_offset : dst_base + 64;
-        }
-        else
-        {
-            dst = dst_base + test->dst_align;
-        }
+static size_t random_slot(size_t slots)
+{
+    rotate_state ^= rotate_state << 13;
+    rotate_state ^= rotate_state >> 7;
+    rotate_state ^= rotate_state << 17;
+    return rotate_state % slots;
+}
 
-        stringop_fn func = is_memmove ? impl->memmove_fn : impl->memcpy_fn;
+/* fresh mode gives dst a new mapping, unless it is inside the src buffer (an overlapping memmove) */
+static int fresh_dst(const struct bench_buffers *home)
+{
+    return home->dst && !(home->dst >= home_src_base && home->dst < home_src_base + home_size);
+}
 
-        /* warmup phase */
-        for (size_t w = 0; w < iterations / 10; w++)
-        {
-            func(dst, src, size);
-            dst[0] ^= src[0];
-        }
+/* a mapping for dst at the same page offset */
+static size_t fresh_size(const struct bench_buffers *home, size_t bytes)
+{
+    return ((uintptr_t)home->dst & 4095) + buffer_span(home->dst_span, bytes);
+}
 
-        double best_gbs = 0, worst_gbs = 0, total_gbs = 0;
-        int valid_measurements = 0;
+/* the buffers for the next call: home as is, home flushed from the caches, a random slot of
+ * the pools, or home with dst in a new mapping */
+static void place_buffers(struct bench_buffers *buf, const struct bench_buffers *home, size_t bytes)
+{
+    size_t stride;
 
-        for (int pass = 0; pass < 5; pass++)
-        {
-            double gb_per_sec = measure_throughput(dst, src, size, iterations, func);
+    *buf = *home;
+    if (cache_mode == CACHE_COLD)
+        evict_buffers(buf, bytes);
+    else if (cache_mode == CACHE_ROTATE)
+    {
+        const size_t slots = rotation_slots(home, bytes, &stride);
+        rotate_buffers(buf, home, random_slot(slots), stride);
+    }
+    else if (cache_mode == CACHE_FRESH && fresh_dst(home))
+    {
+        unsigned char *map = map_fresh(fresh_size(home, bytes));
+        if (map)
+            buf->dst = map + ((uintptr_t)home->dst & 4095);
+    }
+}
 
-            if (gb_per_sec > 0.1 && gb_per_sec < 300.0)
-            {
-                if (valid_measurements == 0)
-                {
-                    best_gbs = worst_gbs = gb_per_sec;
-                }
-                else
-                {
-                    if (gb_per_sec < worst_gbs)
-                        worst_gbs = gb_per_sec;
-                    if (gb_per_sec > best_gbs)
-                        best_gbs = gb_per_sec;
-                }
-                total_gbs += gb_per_sec;
-                valid_measurements++;
-            }
-        }
+/* once the call is done with what place_buffers() gave it */
+static void release_buffers(const struct bench_buffers *buf, const struct bench_buffers *home, size_t bytes)
+{
+    if (cache_mode == CACHE_FRESH && buf->dst != home->dst)
+        unmap_fresh(buf->dst - ((uintptr_t)home->dst & 4095), fresh_size(home, bytes));
+}
 
-        if (valid_measurements > 0)
-        {
-            double avg_gbs = total_gbs / valid_measurements;
-            print_measurement(test->name, best_gbs, worst_gbs, avg_gbs);
+static int setup_rotate_pools(void)
+{
+    pool_size = home_size > ROTATE_POOL_SIZE ? home_size : ROTATE_POOL_SIZE;
+    pool_src = __aligned_alloc(4096, pool_size);
+    pool_dst = __aligned_alloc(4096, pool_size);
+    if (!pool_src || !pool_dst)
+        return 0;
+
+    init_test_buffer(pool_src, 4096);
+    for (size_t i = 4096; i < pool_size; i += 4096)
+        memcpy(pool_src + i, pool_src, 4096);
+    memcpy(pool_dst, pool_src, pool_size);
+    return 1;
+}
 
-            struct perf_stats *stats;
-            if (is_memmove)
-            {
-                stats = test->backwards ? &impl->results.memmove_backward
-                                        : &impl->results.memmove_forward;
-            }
-            else
-            {
-                stats = (test->src_align == 64 && test->dst_align == 64)
-                            ? &impl->results.memcpy_aligned
-                            : &impl->results.memcpy_unaligned;
-            }
+struct stringop_call
+{
+    struct bench_buffers buf;
+    stringop_fn func;
+    size_t size;
+};
 
-            update_perf_stats(stats, avg_gbs);
-            impl->results.total_tests++;
-        }
-        else
-        {
-            printf("\n            \t%s\t|    ERROR - no valid measurements.", test->name);
-        }
-    }
-    printf("\n" SEPARATOR);
+static void run_stringop(void *ctx)
+{
+    struct stringop_call *call = ctx;
+    call->func(call->buf.dst, call->buf.src, call->size);
 }
 
-static size_t estimate_iterations(size_t size, uint64_t target_ns, double expected_gbs)
+static void prepare_stringop(void *ctx)
 {
-    if (expected_gbs <= 0.0)
-        expected_gbs = 16.0;
+    struct stringop_call *call = ctx;
+    init_test_buffer(call->buf.src, call->size);
+}
 
-    double time_per_iter_ns = (double)size / expected_gbs;
-    size_t iterations = (size_t)((target_ns / time_per_iter_ns) / 5); /* 5 passes in each test */
+/* each call on its own, timed apart from the flush before it */
+static double measure_cold(bench_fn op, bench_fn prepare, void *ctx, size_t bytes, size_t iterations)
+{
+    struct bench_buffers *buf = ctx;
+    struct timespec_portable pass_start, start, end;
+    double elapsed = 0;
+    size_t done = 0;
 
-    if (size >= 64 * 1024 * 1024)
-        iterations /= 2;
+    if (prepare)
+        prepare(ctx);
 
-    return iterations < 4 ? 4 : iterations;
+    get_monotonic_time(&pass_start);
+    while (done < iterations)
+    {
+        evict_buffers(buf, bytes);
+        get_monotonic_time(&start);
+        op(ctx);
+        get_monotonic_time(&end);
+        elapsed += timespec_to_seconds(&start, &end);
+        if (++done >= 4 && timespec_to_seconds(&pass_start, &end) * 1e9 > placed_pass_ns)
+            break;
+    }
+    return ((double)bytes * done) / (elapsed * 1e9);
 }
 
-int main(int argc, char **argv)
+/* each call on its own, into a mapping made for it and dropped after it */
+static double measure_fresh(bench_fn op, bench_fn prepare, void *ctx, size_t bytes, size_t iterations)
 {
-    static const struct test_case alignment_cases[] = {
-        {"aligned    ", {.src_align = 64, .dst_align = 64}},
-        {"src+1      ", {.src_align = 65, .dst_align = 64}},
-        {"dst+1      ", {.src_align = 64, .dst_align = 65}},
-        {"both+1     ", {.src_align = 65, .dst_align = 65}},
-        {"worst-case ", {.src_align = 63, .dst_align = 63}}};
+    struct bench_buffers *buf = ctx;
+    const struct bench_buffers home = *buf;
+    struct timespec_portable pass_start, start, end;
+    double elapsed = 0;
+    size_t done = 0;
 
-    struct test_case memmove_cases[] = {
-        {"forward     ", {.overlap_offset = 0, .backwards = 0}},
-        {"back 25%    ", {.overlap_offset = 0, .backwards = 1}},
-        {"back 50%    ", {.overlap_offset = 0, .backwards = 1}},
-        {"back 75%    ", {.overlap_offset = 0, .backwards = 1}},
-        {"back 1-byte ", {.overlap_offset = 0, .backwards = 1}}};
+    if (prepare)
+        prepare(ctx);
 
-    static const size_t bench_sizes[] = {
-        64 * 1024,        /* 64KB - ~L1 cache size */
-        256 * 1024,       /* 256KB - ~L2 cache size */
-        2 * 1024 * 1024,  /* 2MB - ~L3 cache size */
-        16 * 1024 * 1024, /* 16MB - out of cache */
-        64 * 1024 * 1024, /* 64MB */
-    };
-#ifdef SHARED
-    load_functions(&implementations[0]);
-    load_functions(&implementations[1]);
-#endif
-    for (size_t i = 0; i < 2; i++)
+    get_monotonic_time(&pass_start);
+    while (done < iterations)
     {
-        init_test_results(&implementations[i].results);
+        place_buffers(buf, &home, bytes);
+        if (buf->dst == home.dst && fresh_dst(&home))
+            break; /* out of address space */
+
+        get_monotonic_time(&start);
+        op(ctx);
+        get_monotonic_time(&end);
+        elapsed += timespec_to_seconds(&start, &end);
+
+        release_buffers(buf, &home, bytes);
+        if (++done >= 4 && timespec_to_seconds(&pass_start, &end) * 1e9 > placed_pass_ns)
+            break;
     }
+    *buf = home;
+    return done ? ((double)bytes * done) / (elapsed * 1e9) : 0;
+}
 
-    uint64_t target_duration_ns = DEFAULT_TEST_DURATION_NS;
-    double expected_gbs = 0.0;
+/* every slot prepared, then the calls timed together, each on a random slot */
+static double measure_rotated(bench_fn op, bench_fn prepare, void *ctx, size_t bytes, size_t iterations)
+{
+    struct bench_buffers *buf = ctx;
+    const struct bench_buffers home = *buf;
+    struct timespec_portable start, end;
+    size_t stride;
+    const size_t slots = rotation_slots(&home, bytes, &stride);
 
-    for (int i = 1; i < argc; i++)
+    for (size_t k = 0; prepare && k < slots; k++)
     {
-        if (strncmp(argv[i], "--duration=", 11) == 0)
+        rotate_buffers(buf, &home, k, stride);
+        prepare(ctx);
+    }
+
+    get_monotonic_time(&start);
+
+    size_t done = 0;
+    while (done < iterations)
+    {
+        rotate_buffers(buf, &home, random_slot(slots), stride);
+        op(ctx);
+        if ((++done & 63) == 0)
         {
-            double ms = strtod(argv[i] + 11, NULL);
+            get_monotonic_time(&end);
+            if (timespec_to_seconds(&start, &end) * 1e9 > placed_pass_ns)
+                break;
+        }
+    }
+
+    get_monotonic_time(&end);
+    *buf = home;
+    double elapsed = timespec_to_seconds(&start, &end);
+    return ((double)bytes * done) / (elapsed * 1e9);
+}
+
+static double measure_throughput(bench_fn op, bench_fn prepare, void *ctx, size_t bytes, size_t iterations)
+{
+    struct timespec_portable start, end;
+
+    if (cache_mode == CACHE_COLD)
+        return measure_cold(op, prepare, ctx, bytes, iterations);
+    if (cache_mode == CACHE_ROTATE)
+        return measure_rotated(op, prepare, ctx, bytes, iterations);
+    if (cache_mode == CACHE_FRESH)
+        return measure_fresh(op, prepare, ctx, bytes, iterations);
+
+    if (prepare)
+        prepare(ctx);
+
+    get_monotonic_time(&start);
+
+    for (size_t j = 0; j < iterations; j++)
+    {
+        op(ctx);
+    }
+
+    get_monotonic_time(&end);
+    double elapsed = timespec_to_seconds(&start, &end);
+    return ((double)bytes * iterations) / (elapsed * 1e9);
+}
+
+static volatile uint64_t compute_sink;
+
+/* a dependent multiply/shift chain: scalar only, so its speed is just the core clock */
+static uint64_t scalar_compute(uint64_t x, size_t steps)
+{
+    for (size_t i = 0; i < steps; i++)
+    {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        x ^= x >> 29;
+    }
+    return x;
+}
+
+#define WARMUP_MAX_SAMPLES 32
+#define WARMUP_TOLERANCE   0.02 /* warm once two samples in a row are this close */
+#define MIN_SAMPLES        8
+#define MAX_SAMPLES        256
+#define SAMPLES_PER_TARGET 20 /* calls per sample are sized for this many samples in --duration */
+#define DRIFT_TOLERANCE    0.03
+#define REFERENCE_STEPS    65536
+
+/* half width of the median's confidence interval to stop sampling at, relative, from --ci= */
+static double ci_target = 0.01;
+/* wall time one measurement may take before it settles for a wider interval */
+static uint64_t sample_budget_ns;
+
+/* one sample: the GB/s (the mixed and async tables: compute Mop/s) of a short timed run */
+typedef double (*sample_fn)(void *ctx);
+
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p)
+{
+    const double rank = p * (n - 1);
+    const int lo = (int)rank;
+    const int hi = lo + 1 < n ? lo + 1 : lo;
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+/* the order statistics around the median that cover it with 95% confidence, from the normal
+ * approximation of the binomial: no assumption about how the samples themselves are distributed */
+static void median_interval(const double *sorted, int n, double *low, double *high)
+{
+    const double half = 1.96 * sqrt(n) / 2;
+    int lo = (int)floor(n / 2.0 - half);
+    int hi = (int)ceil(n / 2.0 + half) - 1;
+
+    *low = sorted[lo < 0 ? 0 : lo];
+    *high = sorted[hi >= n ? n - 1 : hi];
+}
+
+/* steps/s of the scalar chain, best of five: stands in for the core clock */
+static double reference_rate(void)
+{
+    struct timespec_portable start, end;
+    double best = 0;
+    uint64_t x = 1;
+
+    for (int i = 0; i < 5; i++)
+    {
+        get_monotonic_time(&start);
+        x = scalar_compute(x, REFERENCE_STEPS);
+        get_monotonic_time(&end);
+        const double elapsed = timespec_to_seconds(&start, &end);
+        if (elapsed > 0 && REFERENCE_STEPS / elapsed > best)
+            best = REFERENCE_STEPS / elapsed;
+    }
+    compute_sink = x;
+    return best;
+}
+
+/* warms up until two samples agree, then samples until the median is known to within ci_target or the
+ * budget runs out; returns the number of samples kept */
+static int sample_adaptive(sample_fn sample, void *ctx, struct sample_stats *stats)
+{
+    double samples[MAX_SAMPLES], sorted[MAX_SAMPLES];
+    struct timespec_portable start, now;
+    int n = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    const double clock_before = reference_rate();
+    get_monotonic_time(&start);
+
+    double previous = sample(ctx);
+    for (int w = 1; w < WARMUP_MAX_SAMPLES; w++)
+    {
+        const double current = sample(ctx);
+        if (fabs(current - previous) <= WARMUP_TOLERANCE * previous)
+            break;
+        previous = current;
+        get_monotonic_time(&now);
+        if (timespec_to_seconds(&start, &now) * 1e9 > sample_budget_ns / 4)
+            break;
+    }
+
+    for (int attempt = 0; attempt < MAX_SAMPLES; attempt++)
+    {
+        const double gbs = sample(ctx);
+        if (isfinite(gbs) && gbs > 0)
+            samples[n++] = gbs;
+
+        if (n >= MIN_SAMPLES)
+        {
+            double low, high;
+            memcpy(sorted, samples, n * sizeof(samples[0]));
+            qsort(sorted, n, sizeof(sorted[0]), compare_doubles);
+            median_interval(sorted, n, &low, &high);
+            if ((high - low) / 2 <= ci_target * percentile(sorted, n, 0.5))
+                break;
+        }
+        get_monotonic_time(&now);
+        if (n >= 3 && timespec_to_seconds(&start, &now) * 1e9 > sample_budget_ns)
+            break;
+    }
+    if (!n)
+        return 0;
+
+    qsort(samples, n, sizeof(samples[0]), compare_doubles);
+    stats->median = percentile(samples, n, 0.5);
+    stats->p5 = percentile(samples, n, 0.05);
+    stats->p95 = percentile(samples, n, 0.95);
+    median_interval(samples, n, &stats->ci_low, &stats->ci_high);
+    stats->count = n;
+    stats->drift = fabs(reference_rate() / clock_before - 1) > DRIFT_TOLERANCE;
+    return n;
+}
+
+/* a second quantity a sample function measures along with the one it returns, reported as its median */
+struct side_samples
+{
+    double values[WARMUP_MAX_SAMPLES + MAX_SAMPLES];
+    int count;
+};
+
+static void add_side_sample(struct side_samples *side, double value)
+{
+    if (side->count < WARMUP_MAX_SAMPLES + MAX_SAMPLES)
+        side->values[side->count++] = value;
+}
+
+static double side_median(struct side_samples *side)
+{
+    if (!side->count)
+        return 0;
+    qsort(side->values, side->count, sizeof(side->values[0]), compare_doubles);
+    return percentile(side->values, side->count, 0.5);
+}
+
+/* a failed measurement still takes its slot, so that the pairing with the other implementation holds */
+static void update_perf_stats(struct perf_stats *stats, const struct sample_stats *sample)
+{
+    if (stats->count >= SUMMARY_MAX_CASES)
+        return;
+    stats->median_gbs[stats->count] = sample->count ? sample->median : 0;
+    stats->log_se[stats->count] = sample->count ? (log(sample->ci_high) - log(sample->ci_low)) / (2 * 1.96) : 0;
+    stats->count++;
+}
+
+struct op_sample
+{
+    bench_fn op;
+    bench_fn prepare;
+    void *ctx;
+    size_t bytes;
+    size_t iterations;
+};
+
+static double op_sample(void *arg)
+{
+    const struct op_sample *s = arg;
+    return measure_throughput(s->op, s->prepare, s->ctx, s->bytes, s->iterations);
+}
+
+/* samples op moving bytes each call, iterations calls at a time; ctx starts with a struct bench_buffers */
+static int sample_op(bench_fn op, bench_fn prepare, void *ctx, size_t bytes, size_t iterations,
+                     struct sample_stats *stats)
+{
+    struct op_sample s = {op, prepare, ctx, bytes, iterations};
+    return sample_adaptive(op_sample, &s, stats);
+}
+
+static int sample_throughput(unsigned char *dst, unsigned char *src, size_t size, size_t iterations,
+                             stringop_fn func, struct sample_stats *stats)
+{
+    struct stringop_call call = {{dst, src, 0, 0}, func, size};
+    return sample_op(run_stringop, prepare_stringop, &call, size, iterations, stats);
+}
+
+static void run_test_cases(const struct test_case *cases, size_t num_cases,
+                           size_t size, size_t iterations,
+                           unsigned char *src_base, unsigned char *dst_base,
+                           struct implementation *impl,
+                           enum test_kind kind)
+{
+    const int is_memmove = kind == TEST_MEMMOVE;
+
+    printf("\n%s implementation:", impl->name);
+
+    for (size_t i = 0; i < num_cases; i++)
+    {
+        const struct test_case *test = &cases[i];
+        unsigned char *src = src_base + (is_memmove ? 64 : test->src_align);
+        unsigned char *dst;
+
+        if (is_memmove)
+        {
+            dst = test->backwards ? src + test->overlap_offset : dst_base + 64;
+        }
+        else
+        {
+            dst = dst_base + test->dst_align;
+        }
+
+        stringop_fn func = is_memmove ? impl->memmove_fn : impl->memcpy_fn;
+
+        struct sample_stats sample;
+        if (sample_throughput(dst, src, size, iterations, func, &sample))
+            print_measurement(test->name, &sample);
+        else
+            printf("\n            \t%s\t|    ERROR - no valid measurements.", test->name);
+
+        /* the sweep is only a diagnostic, keep it out of the summary */
+        if (kind == TEST_ALIAS_SWEEP)
+            continue;
+
+        struct perf_stats *stats;
+        if (is_memmove)
+        {
+            stats = test->backwards ? &impl->results.memmove_backward
+                                    : &impl->results.memmove_forward;
+        }
+        else
+        {
+            stats = (test->src_align == 64 && test->dst_align == 64)
+                        ? &impl->results.memcpy_aligned
+                        : &impl->results.memcpy_unaligned;
+        }
+
+        update_perf_stats(stats, &sample);
+        if (sample.count)
+            impl->results.total_tests++;
+    }
+    printf("\n" SEPARATOR);
+}
+
+/* the calls of one sample, so that SAMPLES_PER_TARGET of them take about target_ns */
+static size_t estimate_iterations(size_t size, uint64_t target_ns, double expected_gbs)
+{
+    if (expected_gbs <= 0.0)
+        expected_gbs = 16.0;
+
+    double time_per_iter_ns = (double)size / expected_gbs;
+    size_t iterations = (size_t)((target_ns / time_per_iter_ns) / SAMPLES_PER_TARGET);
+
+    if (size >= 64 * 1024 * 1024)
+        iterations /= 2;
+
+    return iterations < 4 ? 4 : iterations;
+}
+
+static memop_fn current_engine;
+
+static void *engine_forward(void *dst, const void *src, size_t n)
+{
+    return current_engine(dst, src, n, 0);
+}
+
+/* every unroll factor and schedule of every tier this CPU can run, aligned memcpy only */
+static void run_engine_grid(const size_t *sizes, size_t num_sizes, uint64_t target_ns, double expected_gbs,
+                            unsigned char *src_base, unsigned char *dst_base)
+{
+    size_t count;
+    const struct memop_engine *engines = MEMLIB_FN(memop_engines_fn, memop_engines)(&count);
+
+    printf("\n\nmemcpy engine grid (median GB/s):\n");
+    printf("%-32s|", "engine");
+    for (size_t j = 0; j < num_sizes; j++)
+        printf(" %7.2f MB", sizes[j] / (1024.0 * 1024.0));
+    printf("\n" SEPARATOR);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!cpu_supports(engines[i].feature))
+            continue;
+        current_engine = engines[i].fn;
+
+        printf("%-32s|", engines[i].name);
+        for (size_t j = 0; j < num_sizes; j++)
+        {
+            size_t iterations = estimate_iterations(sizes[j], target_ns, expected_gbs);
+            struct sample_stats sample;
+
+            if (sample_throughput(dst_base + 64, src_base + 64, sizes[j], iterations, engine_forward, &sample))
+                printf(" %10.2f", sample.median);
+            else
+                printf("      ERROR");
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    printf(SEPARATOR);
+}
+
+typedef void *(*copy2d_api_fn)(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width,
+                               size_t height);
+
+struct tile_call
+{
+    struct bench_buffers buf;
+    copy2d_api_fn copy2d; /* or one row_fn call per row, when NULL */
+    stringop_fn row_fn;
+    size_t dpitch;
+    size_t spitch;
+    size_t width;
+    size_t height;
+};
+
+static void run_tile_copy(void *ctx)
+{
+    struct tile_call *call = ctx;
+
+    if (call->copy2d)
+    {
+        call->copy2d(call->buf.dst, call->dpitch, call->buf.src, call->spitch, call->width, call->height);
+        return;
+    }
+
+    for (size_t y = 0; y < call->height; y++)
+        call->row_fn(call->buf.dst + y * call->dpitch, call->buf.src + y * call->spitch, call->width);
+}
+
+/* tiles cut out of a larger surface into packed, 64 byte aligned rows */
+static void run_tile_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                           unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t width;
+        size_t height;
+        size_t spitch;
+    } tiles[] = {
+        {"8x8 @ 1B", 8, 8, 4096},
+        {"16x16 @ 4B", 64, 16, 4096},
+        {"100x37 @ 3B", 300, 37, 3000},
+        {"64x64 @ 4B", 256, 64, 8192},
+        {"256x256 @ 4B", 1024, 256, 8192},
+        {"1920x1080 @ 4B", 7680, 1080, 8192},
+    };
+
+    printf("\n\ntile copies:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(tiles) / sizeof(tiles[0]); i++)
+    {
+        const size_t bytes = tiles[i].width * tiles[i].height;
+        const size_t iterations = estimate_iterations(bytes, target_ns, expected_gbs);
+
+        struct tile_call calls[] = {
+            {{0}, MEMLIB_FN(copy2d_api_fn, memcpy2d), NULL, 0, 0, 0, 0},
+            {{0}, NULL, implementations[0].memcpy_fn, 0, 0, 0, 0},
+            {{0}, NULL, implementations[1].memcpy_fn, 0, 0, 0, 0},
+        };
+        static const char *call_names[] = {"memcpy2d    ", "rows (our)  ", "rows stdlib "};
+
+        printf("\n%s:", tiles[i].name);
+        for (size_t j = 0; j < sizeof(calls) / sizeof(calls[0]); j++)
+        {
+            calls[j].dpitch = (tiles[i].width + 63) & ~(size_t)63;
+            calls[j].spitch = tiles[i].spitch;
+            calls[j].width = tiles[i].width;
+            calls[j].height = tiles[i].height;
+            /* the rows are spread over the whole surface, not just bytes of it */
+            calls[j].buf = (struct bench_buffers){dst_base + 64, src_base + 64,
+                                                  (tiles[i].height - 1) * calls[j].dpitch + tiles[i].width,
+                                                  (tiles[i].height - 1) * tiles[i].spitch + tiles[i].width};
+
+            struct sample_stats sample;
+            if (sample_op(run_tile_copy, NULL, &calls[j], bytes, iterations, &sample))
+                print_measurement(call_names[j], &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", call_names[j]);
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+/* a byte swapping copy in one pass, or a copy followed by a second pass swapping in place */
+struct bswap_call
+{
+    struct bench_buffers buf;
+    stringop_fn fused;
+    stringop_fn copy;
+    size_t elem_size;
+    size_t size;
+};
+
+static void run_bswap(void *ctx)
+{
+    struct bswap_call *call = ctx;
+
+    if (call->fused)
+    {
+        call->fused(call->buf.dst, call->buf.src, call->size);
+        return;
+    }
+
+    call->copy(call->buf.dst, call->buf.src, call->size);
+    switch (call->elem_size)
+    {
+    case 2:
+        for (size_t k = 0; k < call->size / 2; k++)
+            ((uint16_t *)call->buf.dst)[k] = __builtin_bswap16(((uint16_t *)call->buf.dst)[k]);
+        break;
+    case 4:
+        for (size_t k = 0; k < call->size / 4; k++)
+            ((uint32_t *)call->buf.dst)[k] = __builtin_bswap32(((uint32_t *)call->buf.dst)[k]);
+        break;
+    case 8:
+        for (size_t k = 0; k < call->size / 8; k++)
+            ((uint64_t *)call->buf.dst)[k] = __builtin_bswap64(((uint64_t *)call->buf.dst)[k]);
+        break;
+    }
+}
+
+static void run_bswap_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                            unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"L1   (16 KB)", 16 * 1024},
+        {"L2  (256 KB)", 256 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+
+    const struct
+    {
+        const char *fused_name;
+        const char *split_name;
+        stringop_fn fused;
+        size_t elem_size;
+    } kernels[] = {
+        {"bswap16     ", "copy+swap16 ", MEMLIB_FN(stringop_fn, memcpy_bswap16), 2},
+        {"bswap32     ", "copy+swap32 ", MEMLIB_FN(stringop_fn, memcpy_bswap32), 4},
+        {"bswap64     ", "copy+swap64 ", MEMLIB_FN(stringop_fn, memcpy_bswap64), 8},
+    };
+
+    printf("\n\nbyte swapping copies:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i].size, target_ns, expected_gbs);
+
+        printf("\n%s:", sizes[i].name);
+        for (size_t j = 0; j < sizeof(kernels) / sizeof(kernels[0]); j++)
+        {
+            for (int split = 0; split < 2; split++)
+            {
+                struct bswap_call call = {{dst_base + 64, src_base + 64, 0, 0},
+                                          split ? NULL : kernels[j].fused,
+                                          implementations[0].memcpy_fn,
+                                          kernels[j].elem_size,
+                                          sizes[i].size};
+                const char *name = split ? kernels[j].split_name : kernels[j].fused_name;
+
+                struct sample_stats sample;
+                if (sample_op(run_bswap, NULL, &call, sizes[i].size, iterations, &sample))
+                    print_measurement(name, &sample);
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+            }
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef void *(*memchr_fn)(const void *s, int c, size_t n);
+typedef size_t (*strlen_fn)(const char *s);
+typedef size_t (*strnlen_fn)(const char *s, size_t maxlen);
+
+enum scan_kind
+{
+    SCAN_MEMCHR,
+    SCAN_MEMRCHR,
+    SCAN_STRLEN,
+    SCAN_STRNLEN,
+};
+
+struct scan_call
+{
+    struct bench_buffers buf; /* only src is read */
+    enum scan_kind kind;
+    union
+    {
+        memchr_fn memchr_fn;
+        strlen_fn strlen_fn;
+        strnlen_fn strnlen_fn;
+        void *fn;
+    };
+    size_t size;
+};
+
+/* whatever the scan looks for sits at the far end of the buffer */
+static void prepare_scan(void *ctx)
+{
+    struct scan_call *call = ctx;
+    memset(call->buf.src, 'a', call->size);
+    if (call->kind == SCAN_MEMRCHR)
+        call->buf.src[0] = 'X';
+    else
+        call->buf.src[call->size - 1] = call->kind == SCAN_MEMCHR ? 'X' : '\0';
+}
+
+static void run_scan(void *ctx)
+{
+    struct scan_call *call = ctx;
+    volatile size_t sink;
+
+    switch (call->kind)
+    {
+    case SCAN_MEMCHR:
+    case SCAN_MEMRCHR:
+        sink = (size_t)call->memchr_fn(call->buf.src, 'X', call->size);
+        break;
+    case SCAN_STRLEN:
+        sink = call->strlen_fn((const char *)call->buf.src);
+        break;
+    case SCAN_STRNLEN:
+        sink = call->strnlen_fn((const char *)call->buf.src, call->size);
+        break;
+    }
+    (void)sink;
+}
+
+static void run_scan_table(const size_t *sizes, size_t num_sizes, uint64_t target_ns, double expected_gbs,
+                           unsigned char *src_base)
+{
+    const struct
+    {
+        const char *name;
+        enum scan_kind kind;
+        void *ours;
+        void *theirs;
+    } scans[] = {
+        {"memchr ", SCAN_MEMCHR, (void *)MEMLIB_FN(memchr_fn, memchr_local), (void *)STDLIB_FN(memchr_fn, memchr)},
+#ifndef _WIN32
+        {"memrchr", SCAN_MEMRCHR, (void *)MEMLIB_FN(memchr_fn, memrchr_local), (void *)STDLIB_FN(memchr_fn, memrchr)},
+#else
+        {"memrchr", SCAN_MEMRCHR, (void *)MEMLIB_FN(memchr_fn, memrchr_local), NULL},
+#endif
+        {"strlen ", SCAN_STRLEN, (void *)MEMLIB_FN(strlen_fn, strlen_local), (void *)STDLIB_FN(strlen_fn, strlen)},
+        {"strnlen", SCAN_STRNLEN, (void *)MEMLIB_FN(strnlen_fn, strnlen_local), (void *)STDLIB_FN(strnlen_fn, strnlen)},
+    };
+
+    printf("\n\nscan throughput (bytes scanned):\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i], target_ns, expected_gbs);
+
+        printf("\n%7.2f MB: ", sizes[i] / (1024.0 * 1024.0));
+        for (size_t j = 0; j < sizeof(scans) / sizeof(scans[0]); j++)
+        {
+            for (int theirs = 0; theirs < 2; theirs++)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "%s %-4s", scans[j].name, theirs ? "std" : "our");
+
+                struct scan_call call = {.buf = {NULL, src_base + 64, 0, 0},
+                                         .kind = scans[j].kind,
+                                         .fn = theirs ? scans[j].theirs : scans[j].ours,
+                                         .size = sizes[i]};
+                struct sample_stats sample;
+                if (!call.fn)
+                    printf("\n            \t%s\t|    n/a", name);
+                else if (sample_op(run_scan, prepare_scan, &call, sizes[i], iterations, &sample))
+                    print_measurement(name, &sample);
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+            }
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef void *(*pad_fn)(void *dst, const void *src, size_t n, size_t total, int fill);
+typedef void *(*memset_fn)(void *s, int c, size_t n);
+typedef char *(*stpcpy_fn)(char *dst, const char *src);
+typedef char *(*stpncpy_fn)(char *dst, const char *src, size_t n);
+typedef size_t (*strlcpy_fn)(char *dst, const char *src, size_t size);
+
+enum pad_kind
+{
+    PAD_RECORD,
+    PAD_STPCPY,
+    PAD_STPNCPY,
+    PAD_STRLCPY,
+};
+
+/* a fused copy-and-fill, or (with fn unset) the same result from separate scan, copy and fill calls */
+struct pad_call
+{
+    struct bench_buffers buf;
+    enum pad_kind kind;
+    union
+    {
+        pad_fn pad_fn;
+        stpcpy_fn stpcpy_fn;
+        stpncpy_fn stpncpy_fn;
+        strlcpy_fn strlcpy_fn;
+        void *fn;
+    };
+    stringop_fn copy;
+    memset_fn fill;
+    strlen_fn strlen_fn;
+    strnlen_fn strnlen_fn;
+    size_t size;
+};
+
+/* records and stpncpy copy three quarters and fill the rest; the others copy all of it */
+static size_t pad_copied(const struct pad_call *call)
+{
+    return call->kind == PAD_RECORD || call->kind == PAD_STPNCPY ? call->size / 4 * 3 : call->size - 1;
+}
+
+static void prepare_pad(void *ctx)
+{
+    struct pad_call *call = ctx;
+    memset(call->buf.src, 'a', call->size);
+    call->buf.src[pad_copied(call)] = '\0';
+}
+
+static void run_pad(void *ctx)
+{
+    struct pad_call *call = ctx;
+    char *dst = (char *)call->buf.dst;
+    char *src = (char *)call->buf.src;
+    const size_t copied = pad_copied(call);
+    size_t len;
+
+    switch (call->kind)
+    {
+    case PAD_RECORD:
+        if (call->fn)
+            call->pad_fn(dst, src, copied, call->size, 0);
+        else
+        {
+            call->copy(dst, src, copied);
+            call->fill(dst + copied, 0, call->size - copied);
+        }
+        break;
+    case PAD_STPCPY:
+        if (call->fn)
+            call->stpcpy_fn(dst, src);
+        else
+            call->copy(dst, src, call->strlen_fn(src) + 1);
+        break;
+    case PAD_STPNCPY:
+        if (call->fn)
+            call->stpncpy_fn(dst, src, call->size);
+        else
+        {
+            len = call->strnlen_fn(src, call->size);
+            call->copy(dst, src, len);
+            call->fill(dst + len, 0, call->size - len);
+        }
+        break;
+    case PAD_STRLCPY:
+        if (call->fn)
+            call->strlcpy_fn(dst, src, call->size);
+        else
+        {
+            len = call->strlen_fn(src);
+            len = len < call->size - 1 ? len : call->size - 1;
+            call->copy(dst, src, len);
+            dst[len] = '\0';
+        }
+        break;
+    }
+}
+
+static void run_pad_table(const size_t *sizes, size_t num_sizes, uint64_t target_ns, double expected_gbs,
+                          unsigned char *src_base, unsigned char *dst_base)
+{
+    const struct
+    {
+        const char *name;
+        enum pad_kind kind;
+        void *ours;
+        void *theirs;
+    } ops[] = {
+        {"pad    ", PAD_RECORD, (void *)MEMLIB_FN(pad_fn, memcpy_pad), NULL},
+#ifndef _WIN32
+        {"stpcpy ", PAD_STPCPY, (void *)MEMLIB_FN(stpcpy_fn, stpcpy_local), (void *)STDLIB_FN(stpcpy_fn, stpcpy)},
+        {"stpncpy", PAD_STPNCPY, (void *)MEMLIB_FN(stpncpy_fn, stpncpy_local),
+         (void *)STDLIB_FN(stpncpy_fn, stpncpy)},
+#else
+        {"stpcpy ", PAD_STPCPY, (void *)MEMLIB_FN(stpcpy_fn, stpcpy_local), NULL},
+        {"stpncpy", PAD_STPNCPY, (void *)MEMLIB_FN(stpncpy_fn, stpncpy_local), NULL},
+#endif
+        {"strlcpy", PAD_STRLCPY, (void *)MEMLIB_FN(strlcpy_fn, strlcpy_local), NULL},
+    };
+    const memset_fn fill = STDLIB_FN(memset_fn, memset);
+    const strlen_fn find_end = MEMLIB_FN(strlen_fn, strlen_local);
+    const strnlen_fn find_bounded_end = MEMLIB_FN(strnlen_fn, strnlen_local);
+
+    printf("\n\nfused copy and fill (our, stdlib, our copy + separate scan/fill calls):\n%s%s", ALIGNMENT_HEADER,
+           SEPARATOR);
+
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i], target_ns, expected_gbs);
+
+        printf("\n%7.2f MB: ", sizes[i] / (1024.0 * 1024.0));
+        for (size_t j = 0; j < sizeof(ops) / sizeof(ops[0]); j++)
+        {
+            const char *const variants[] = {"our", "std", "2-call"};
+            for (int k = 0; k < 3; k++)
+            {
+                /* no libc record padder, and strlcpy is too new to count on */
+                if (k == 1 && !ops[j].theirs)
+                    continue;
+
+                char name[32];
+                snprintf(name, sizeof(name), "%s %-6s", ops[j].name, variants[k]);
+
+                struct pad_call call = {.buf = {dst_base + 64, src_base + 64, 0, 0},
+                                        .kind = ops[j].kind,
+                                        .fn = k == 0 ? ops[j].ours : k == 1 ? ops[j].theirs : NULL,
+                                        .copy = implementations[0].memcpy_fn,
+                                        .fill = fill,
+                                        .strlen_fn = find_end,
+                                        .strnlen_fn = find_bounded_end,
+                                        .size = sizes[i]};
+                struct sample_stats sample;
+                if (sample_op(run_pad, prepare_pad, &call, sizes[i], iterations, &sample))
+                    print_measurement(name, &sample);
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+            }
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+/* a persistent copy in one pass, or a cached copy followed by a write back loop and a fence */
+struct persist_call
+{
+    struct bench_buffers buf;
+    stringop_fn persist;
+    stringop_fn copy;
+    size_t size;
+};
+
+static void run_persist(void *ctx)
+{
+    struct persist_call *call = ctx;
+
+    if (call->persist)
+    {
+        call->persist(call->buf.dst, call->buf.src, call->size);
+        return;
+    }
+
+    call->copy(call->buf.dst, call->buf.src, call->size);
+    cpu_writeback(call->buf.dst, call->size);
+    cpu_persist_fence();
+}
+
+static void run_persist_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                              unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"rec  (256 B)", 256},
+        {"rec   (4 KB)", 4 * 1024},
+        {"L2  (256 KB)", 256 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+    const stringop_fn persist = MEMLIB_FN(stringop_fn, memcpy_persist);
+    const char *names[] = {"persist     ", "copy+flush  ", "persist +8  ", "copy+flush+8"};
+
+    printf("\n\npersistent copies (%s write back):\n%s%s",
+#ifdef __aarch64__
+           cpu_has_feature(CPU_FEATURE_DCPOP) ? "dc cvap" : "dc cvac",
+#else
+           cpu_has_feature(CPU_FEATURE_CLWB) ? "clwb" : cpu_has_feature(CPU_FEATURE_CLFLUSHOPT) ? "clflushopt" : "clflush",
+#endif
+           ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i].size, target_ns, expected_gbs);
+
+        printf("\n%s:", sizes[i].name);
+        for (int j = 0; j < 4; j++)
+        {
+            /* line aligned, or appended 8 bytes into a line as log records often are */
+            struct persist_call call = {{dst_base + 64 + (j & 2 ? 8 : 0), src_base + 64, 0, 0},
+                                        j & 1 ? NULL : persist,
+                                        implementations[0].memcpy_fn,
+                                        sizes[i].size};
+
+            struct sample_stats sample;
+            if (sample_op(run_persist, NULL, &call, sizes[i].size, iterations, &sample))
+                print_measurement(names[j], &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", names[j]);
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef size_t (*delta_fn)(void *dst, const void *src, size_t n, uint64_t *dirty_lines);
+
+/* whether index is one of a fixed, scattered percent of all indices: the changed lines of the delta
+ * table, the zero pages of the sparse one */
+static int scattered(size_t index, int percent)
+{
+    return (int)((index * 2654435761ULL >> 8) % 100) < percent;
+}
+
+/* calls alternating between two sources, so that dst always holds the other one and each call
+ * finds the same lines changed; always on hot buffers, since every cache mode would break that */
+static double measure_delta(delta_fn delta, stringop_fn copy, unsigned char *dst, unsigned char *const src[2],
+                            size_t size, size_t iterations)
+{
+    struct timespec_portable start, end;
+
+    memcpy(dst, src[1], size);
+    get_monotonic_time(&start);
+    for (size_t j = 0; j < iterations; j++)
+    {
+        if (delta)
+            delta(dst, src[j & 1], size, NULL);
+        else
+            copy(dst, src[j & 1], size);
+    }
+    get_monotonic_time(&end);
+    return ((double)size * iterations) / (timespec_to_seconds(&start, &end) * 1e9);
+}
+
+struct delta_sample
+{
+    delta_fn delta;
+    stringop_fn copy;
+    unsigned char *dst;
+    unsigned char *src[2];
+    size_t size;
+    size_t iterations;
+};
+
+static double delta_sample(void *arg)
+{
+    const struct delta_sample *s = arg;
+    return measure_delta(s->delta, s->copy, s->dst, s->src, s->size, s->iterations);
+}
+
+static void run_delta_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base, unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"L2  (256 KB)", 256 * 1024},
+        {"L3    (4 MB)", 4 * 1024 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+    static const int densities[] = {-1, 0, 1, 10, 50, 100};
+    const delta_fn delta = MEMLIB_FN(delta_fn, memcpy_delta);
+
+    /* the lines each call stores, as memcpy_delta reports them: what has to be written back later */
+    uint64_t *dirty_lines = malloc((MEMCPY_DELTA_LINES(64, sizes[2].size) + 63) / 64 * sizeof(uint64_t));
+
+    printf("\n\ndelta copies (a plain memcpy, then memcpy_delta with a share of the lines changed; the KB "
+           "each call dirties, all of dst for memcpy and the lines memcpy_delta stored to for it):\n%s%s",
+           ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        const size_t size = sizes[i].size;
+        const size_t iterations = estimate_iterations(size, target_ns, expected_gbs);
+        unsigned char *const src[2] = {src_base + 64, src_base + 64 + size};
+
+        init_test_buffer(src[0], size);
+        printf("\n%s:", sizes[i].name);
+        for (size_t j = 0; j < sizeof(densities) / sizeof(densities[0]); j++)
+        {
+            const int density = densities[j];
+            size_t dirtied = size / 64;
+            char name[32];
+
+            /* one byte flipped in each changed line */
+            memcpy(src[1], src[0], size);
+            for (size_t line = 0; line < size / 64; line++)
+            {
+                if (density < 0 || scattered(line, density))
+                    src[1][line * 64 + 17] ^= 0xff;
+            }
+            if (density < 0)
+                snprintf(name, sizeof(name), "memcpy      ");
+            else
+                snprintf(name, sizeof(name), "delta  %3d%% ", density);
+
+            struct delta_sample s = {density < 0 ? NULL : delta, implementations[0].memcpy_fn, dst_base + 64,
+                                     {src[0], src[1]}, size, iterations};
+            struct sample_stats sample;
+            if (sample_adaptive(delta_sample, &s, &sample))
+            {
+                if (density >= 0)
+                {
+                    memcpy(s.dst, src[1], size);
+                    delta(s.dst, src[0], size, dirty_lines);
+                    dirtied = 0;
+                    for (size_t w = 0; w < (MEMCPY_DELTA_LINES(s.dst, size) + 63) / 64; w++)
+                        dirtied += (size_t)__builtin_popcountll(dirty_lines[w]);
+                }
+                print_measurement(name, &sample);
+                printf("  %9zu KB dirtied", dirtied * 64 / 1024);
+            }
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+        }
+        printf("\n" SEPARATOR);
+    }
+    free(dirty_lines);
+}
+
+typedef size_t (*sparse_fn)(void *dst, const void *src, size_t n, uint64_t *zero_pages);
+
+/* a sparse copy of a source with a given percent of its pages zero, or (with sparse unset) a plain memcpy */
+struct sparse_call
+{
+    struct bench_buffers buf;
+    sparse_fn sparse;
+    stringop_fn copy;
+    uint64_t *zero_pages;
+    size_t size;
+    int zero_percent;
+};
+
+static void prepare_sparse(void *ctx)
+{
+    struct sparse_call *call = ctx;
+    init_test_buffer(call->buf.src, call->size);
+    for (size_t page = 0; page * MEMCPY_SPARSE_PAGE_SIZE < call->size; page++)
+    {
+        if (scattered(page, call->zero_percent))
+            memset(call->buf.src + page * MEMCPY_SPARSE_PAGE_SIZE, 0, MEMCPY_SPARSE_PAGE_SIZE);
+    }
+}
+
+static void run_sparse(void *ctx)
+{
+    struct sparse_call *call = ctx;
+    if (call->sparse)
+        call->sparse(call->buf.dst, call->buf.src, call->size, call->zero_pages);
+    else
+        call->copy(call->buf.dst, call->buf.src, call->size);
+}
+
+static void run_sparse_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                             unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"L3    (4 MB)", 4 * 1024 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+    static const int zero_percents[] = {-1, 0, 10, 50, 90, 100};
+    const sparse_fn sparse = MEMLIB_FN(sparse_fn, memcpy_sparse);
+    uint64_t *zero_pages = malloc((MEMCPY_SPARSE_PAGES(0, sizes[1].size) + 63) / 64 * sizeof(uint64_t));
+
+    printf("\n\nsparse copies (a plain memcpy, then memcpy_sparse with a share of the source pages zero):\n%s%s",
+           ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i].size, target_ns, expected_gbs);
+
+        printf("\n%s:", sizes[i].name);
+        for (size_t j = 0; j < sizeof(zero_percents) / sizeof(zero_percents[0]); j++)
+        {
+            const int percent = zero_percents[j];
+            char name[32];
+
+            if (percent < 0)
+                snprintf(name, sizeof(name), "memcpy      ");
+            else
+                snprintf(name, sizeof(name), "zero   %3d%% ", percent);
+
+            /* page aligned, so the zero pages of src and dst line up */
+            struct sparse_call call = {{dst_base + 4096, src_base + 4096, 0, 0},
+                                       percent < 0 ? NULL : sparse,
+                                       implementations[0].memcpy_fn,
+                                       zero_pages,
+                                       sizes[i].size,
+                                       percent < 0 ? 0 : percent};
+            struct sample_stats sample;
+            if (sample_op(run_sparse, prepare_sparse, &call, sizes[i].size, iterations, &sample))
+                print_measurement(name, &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+        }
+        printf("\n" SEPARATOR);
+    }
+    free(zero_pages);
+}
+
+typedef void (*swap_fn)(void *a, void *b, size_t n);
+typedef void *(*rotate_fn)(void *buf, size_t n, size_t shift);
+
+/* dst and src swapped, or dst rotated by shift, through the library; with neither set, the same
+ * the usual way, through a temporary allocation and three memmoves */
+struct rotate_call
+{
+    struct bench_buffers buf;
+    swap_fn swap;
+    rotate_fn rotate;
+    stringop_fn move;
+    size_t size;
+    size_t shift; /* 0 for a swap */
+};
+
+static void run_rotate(void *ctx)
+{
+    struct rotate_call *call = ctx;
+    unsigned char *const p = call->buf.dst;
+    const size_t n = call->size, left = call->shift;
+
+    if (call->swap)
+        call->swap(p, call->buf.src, n);
+    else if (call->rotate)
+        call->rotate(p, n, left);
+    else if (!left)
+    {
+        unsigned char *tmp = malloc(n);
+        call->move(tmp, p, n);
+        call->move(p, call->buf.src, n);
+        call->move(call->buf.src, tmp, n);
+        free(tmp);
+    }
+    else
+    {
+        unsigned char *tmp = malloc(left);
+        call->move(tmp, p, left);
+        call->move(p, p + left, n - left);
+        call->move(p + n - left, tmp, left);
+        free(tmp);
+    }
+}
+
+static void run_rotate_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                             unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"L1    (4 KB)", 4 * 1024},
+        {"L2  (256 KB)", 256 * 1024},
+        {"L3    (4 MB)", 4 * 1024 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+    /* shift: 0 swaps, 1 rotates by a third, anything else by that many bytes */
+    static const struct
+    {
+        const char *name;
+        size_t shift;
+        int library;
+    } rows[] = {
+        {"swap temp   ", 0, 0}, {"memswap     ", 0, 1},  {"rot 1/3 tmp ", 1, 0},
+        {"memrot 1/3  ", 1, 1}, {"rot 64 tmp  ", 64, 0}, {"memrot 64   ", 64, 1},
+    };
+    const swap_fn swap = MEMLIB_FN(swap_fn, memswap_local);
+    const rotate_fn rotate = MEMLIB_FN(rotate_fn, memrotate_local);
+
+    printf("\n\nin place swaps and rotations (GB/s of the bytes swapped or rotated; tmp: a temporary "
+           "allocation and three memmoves):\n%s%s",
+           ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        const size_t size = sizes[i].size;
+        const size_t iterations = estimate_iterations(size, target_ns, expected_gbs);
+
+        printf("\n%s:", sizes[i].name);
+        for (size_t j = 0; j < sizeof(rows) / sizeof(rows[0]); j++)
+        {
+            const size_t shift = rows[j].shift == 1 ? size / 3 : rows[j].shift;
+            struct rotate_call call = {{dst_base + 64, shift ? NULL : src_base + 64, 0, 0},
+                                       rows[j].library && !shift ? swap : NULL,
+                                       rows[j].library && shift ? rotate : NULL,
+                                       implementations[0].memmove_fn,
+                                       size,
+                                       shift};
+            struct sample_stats sample;
+            if (sample_op(run_rotate, NULL, &call, size, iterations, &sample))
+                print_measurement(rows[j].name, &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", rows[j].name);
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef void *(*gather_api_fn)(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size);
+
+/* count records of size bytes by index, through the library or one memcpy per record */
+struct gather_call
+{
+    struct bench_buffers buf;
+    gather_api_fn gather;
+    stringop_fn copy;
+    const uint32_t *idx;
+    size_t count;
+    size_t size;
+};
+
+static void run_gather(void *ctx)
+{
+    struct gather_call *call = ctx;
+
+    if (call->gather)
+    {
+        call->gather(call->buf.dst, call->buf.src, call->idx, call->count, call->size);
+        return;
+    }
+
+    for (size_t i = 0; i < call->count; i++)
+        call->copy(call->buf.dst + i * call->size, call->buf.src + (size_t)call->idx[i] * call->size, call->size);
+}
+
+static int compare_indices(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+#define GATHER_CALL_RECORDS 8192
+
+/* records picked out of a table at random, or at the same indices in ascending order, into a
+ * packed buffer and back */
+static void run_gather_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                             unsigned char *dst_base)
+{
+    static const size_t record_sizes[] = {8, 16, 64, 256};
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } tables[] = {
+        {"256 KB", 256 * 1024},
+        {"64 MB", 64 * 1024 * 1024},
+    };
+    static const char *const row_names[] = {"loop random ", "gather rnd  ", "scatter rnd ",
+                                             "loop sorted ", "gather srt  ", "scatter srt "};
+    const gather_api_fn gather = MEMLIB_FN(gather_api_fn, memcpy_gather);
+    const gather_api_fn scatter = MEMLIB_FN(gather_api_fn, memcpy_scatter);
+    uint32_t *random_idx = malloc(GATHER_CALL_RECORDS * sizeof(*random_idx));
+    uint32_t *sorted_idx = malloc(GATHER_CALL_RECORDS * sizeof(*sorted_idx));
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+
+    printf("\n\nindexed record copies (GB/s of the records copied, %d a call; loop: one memcpy per record):\n%s%s",
+           GATHER_CALL_RECORDS, ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(record_sizes) / sizeof(record_sizes[0]); i++)
+    {
+        const size_t size = record_sizes[i], bytes = GATHER_CALL_RECORDS * size;
+        const size_t iterations = estimate_iterations(bytes, target_ns, expected_gbs);
+
+        for (size_t j = 0; j < sizeof(tables) / sizeof(tables[0]); j++)
+        {
+            const size_t records = tables[j].size / size;
+            for (size_t k = 0; k < GATHER_CALL_RECORDS; k++)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                random_idx[k] = (uint32_t)(state % records);
+            }
+            memcpy(sorted_idx, random_idx, GATHER_CALL_RECORDS * sizeof(*sorted_idx));
+            qsort(sorted_idx, GATHER_CALL_RECORDS, sizeof(*sorted_idx), compare_indices);
+
+            printf("\n%zu B records, %s table:", size, tables[j].name);
+            for (size_t row = 0; row < sizeof(row_names) / sizeof(row_names[0]); row++)
+            {
+                /* the table is the indexed side: src for the loop and gathers, dst for scatters */
+                const int scattering = row % 3 == 2;
+                const gather_api_fn api = row % 3 == 0 ? NULL : scattering ? scatter : gather;
+                struct gather_call call = {{dst_base + 64, src_base + 64, scattering ? tables[j].size : bytes,
+                                            scattering ? bytes : tables[j].size},
+                                           api,
+                                           implementations[0].memcpy_fn,
+                                           row < 3 ? random_idx : sorted_idx,
+                                           GATHER_CALL_RECORDS,
+                                           size};
+                struct sample_stats sample;
+                if (sample_op(run_gather, NULL, &call, bytes, iterations, &sample))
+                    print_measurement(row_names[row], &sample);
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", row_names[row]);
+            }
+            printf("\n" SEPARATOR);
+        }
+    }
+
+    free(random_idx);
+    free(sorted_idx);
+}
+
+/* --profile=: a recorded histogram of "size alignment count" lines, as "make PROFILE=" takes */
+static const char *profile_path;
+
+#define PROFILE_CALLS 65536
+#define PROFILE_SLOTS 64
+
+/* one call of a replay: its size, and the offset of both pointers into the buffers, a slot
+ * plus the recorded alignment */
+struct replay_call
+{
+    size_t size;
+    size_t offset;
+};
+
+/* the histogram as PROFILE_CALLS or so calls, each pair as often as its share of the counts (at
+ * least once), the most frequent first; NULL, having said why, on a bad file */
+static struct replay_call *load_profile(const char *path, size_t limit, size_t *calls, size_t *pairs,
+                                        size_t *bytes)
+{
+    FILE *f = fopen(path, "r");
+    size_t (*hist)[3] = NULL, count = 0, capacity = 0, total = 0, max_size = 0;
+    char line[256];
+
+    if (!f)
+    {
+        printf("(can't open the profile %s)\n", path);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        size_t size, alignment, n;
+        const char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || !*p)
+            continue;
+        if (sscanf(p, "%zu %zu %zu", &size, &alignment, &n) != 3 || !alignment || (alignment & (alignment - 1)))
+        {
+            printf("(bad line in the profile %s: %s)\n", path, line);
+            fclose(f);
+            free(hist);
+            return NULL;
+        }
+        if (!size || !n)
+            continue;
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            size_t (*grown)[3] = realloc(hist, capacity * sizeof(hist[0]));
+            if (!grown)
+            {
+                printf("(out of memory reading the profile %s)\n", path);
+                fclose(f);
+                free(hist);
+                return NULL;
+            }
+            hist = grown;
+        }
+        hist[count][0] = size;
+        hist[count][1] = alignment < 64 ? alignment : 64;
+        hist[count][2] = n;
+        total += n;
+        max_size = size > max_size ? size : max_size;
+        count++;
+    }
+    fclose(f);
+
+    const size_t stride = (max_size + 64 + 4095) & ~(size_t)4095;
+    if (!count || stride > limit)
+    {
+        printf(count ? "(the profile %s has sizes too large to replay)\n" : "(no pairs in the profile %s)\n", path);
+        free(hist);
+        return NULL;
+    }
+    const size_t slots = limit / stride < PROFILE_SLOTS ? limit / stride : PROFILE_SLOTS;
+
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++)
+        n += hist[i][2] * PROFILE_CALLS / total ? hist[i][2] * PROFILE_CALLS / total : 1;
+    struct replay_call *replay = malloc(n * sizeof(*replay));
+    if (!replay)
+    {
+        printf("(out of memory replaying the profile %s)\n", path);
+        free(hist);
+        return NULL;
+    }
+
+    *bytes = 0;
+    for (size_t i = 0, k = 0; i < count; i++)
+    {
+        const size_t repeats = hist[i][2] * PROFILE_CALLS / total ? hist[i][2] * PROFILE_CALLS / total : 1;
+        for (size_t j = 0; j < repeats; j++, k++)
+        {
+            replay[k] = (struct replay_call){hist[i][0], (k % slots) * stride + hist[i][1] % 64};
+            *bytes += hist[i][0];
+        }
+    }
+
+    *calls = n;
+    *pairs = count;
+    free(hist);
+    return replay;
+}
+
+/* Fisher-Yates with a fixed xorshift, so that every run and every row replays the same order */
+static void shuffle_replay(struct replay_call *calls, size_t n)
+{
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = n - 1; i > 0; i--)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        const size_t j = x % (i + 1);
+        const struct replay_call tmp = calls[i];
+        calls[i] = calls[j];
+        calls[j] = tmp;
+    }
+}
+
+struct replay_sample
+{
+    stringop_fn copy;
+    unsigned char *dst;
+    unsigned char *src;
+    const struct replay_call *calls;
+    size_t count;
+    size_t bytes;
+    size_t passes;
+};
+
+/* whole passes over the replay, always on hot buffers: the copies are small, and their order is the point */
+static double replay_sample(void *arg)
+{
+    const struct replay_sample *s = arg;
+    struct timespec_portable start, end;
+
+    get_monotonic_time(&start);
+    for (size_t pass = 0; pass < s->passes; pass++)
+    {
+        for (size_t i = 0; i < s->count; i++)
+            s->copy(s->dst + s->calls[i].offset, s->src + s->calls[i].offset, s->calls[i].size);
+    }
+    get_monotonic_time(&end);
+    return ((double)s->bytes * s->passes) / (timespec_to_seconds(&start, &end) * 1e9);
+}
+
+/* every implementation's memcpy, then memcpy_profiled, replaying the same histogram: with each pair's calls
+ * together, where every branch predicts, and shuffled, where none of them do (a real trace falls in between);
+ * the ns per call follow each row */
+static void run_profile_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                              unsigned char *dst_base, size_t limit)
+{
+    size_t count, pairs, bytes;
+
+    printf("\n\nprofile replay (calls drawn from a size histogram, memcpy_profiled against each memcpy):\n");
+    if (!profile_path)
+    {
+        printf("(needs --profile=file, the histogram \"make PROFILE=\" built the library with)\n");
+        return;
+    }
+
+    struct replay_call *calls = load_profile(profile_path, limit, &count, &pairs, &bytes);
+    if (!calls)
+        return;
+
+    const stringop_fn profiled = MEMLIB_FN(stringop_fn, memcpy_profiled);
+    const size_t passes = estimate_iterations(bytes, target_ns, expected_gbs) + 1;
+
+    printf("%zu calls of %zu pairs from %s, %.1f bytes on average:\n%s%s", count, pairs, profile_path,
+           (double)bytes / count, ALIGNMENT_HEADER, SEPARATOR);
+    for (int shuffled = 0; shuffled < 2; shuffled++)
+    {
+        if (shuffled)
+            shuffle_replay(calls, count);
+        printf("\n%s:", shuffled ? "shuffled    " : "grouped     ");
+        for (size_t i = 0; i <= num_implementations; i++)
+        {
+            const stringop_fn copy = i < num_implementations ? implementations[i].memcpy_fn : profiled;
+            struct replay_sample s = {copy, dst_base, src_base, calls, count, bytes, passes};
+            struct sample_stats sample;
+            char name[32];
+
+            snprintf(name, sizeof(name), "%-12.12s", i < num_implementations ? implementations[i].name : "profiled");
+            if (sample_adaptive(replay_sample, &s, &sample))
+            {
+                print_measurement(name, &sample);
+                printf("  %7.2f ns", (double)bytes / count / sample.median);
+            }
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+        }
+        printf("\n" SEPARATOR);
+    }
+    free(calls);
+}
+
+typedef void *(*hint_fn)(void *dst, const void *src, size_t n, int flags);
+
+static volatile uint64_t consumer_sink;
+
+/* the consumer of a copy, reading each word of it once */
+static uint64_t consume(const unsigned char *p, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i + 8 <= n; i += 8)
+    {
+        uint64_t x;
+        memcpy(&x, p + i, 8);
+        sum += x;
+    }
+    return sum;
+}
+
+/* GB/s of the consumer's pass over dst right after each copy; the copies themselves aren't timed */
+static double measure_consumer(hint_fn copy, int flags, unsigned char *dst, unsigned char *src, size_t size,
+                               size_t iterations)
+{
+    const struct bench_buffers home = {dst, src, 0, 0};
+    struct bench_buffers buf;
+    struct timespec_portable start, end;
+    double elapsed = 0;
+    uint64_t sum = 0;
+
+    for (size_t j = 0; j < iterations; j++)
+    {
+        place_buffers(&buf, &home, size);
+        copy(buf.dst, buf.src, size, flags);
+        get_monotonic_time(&start);
+        sum += consume(buf.dst, size);
+        get_monotonic_time(&end);
+        release_buffers(&buf, &home, size);
+        elapsed += timespec_to_seconds(&start, &end);
+    }
+    consumer_sink = sum;
+    return ((double)size * iterations) / (elapsed * 1e9);
+}
+
+struct consumer_sample
+{
+    hint_fn copy;
+    int flags;
+    unsigned char *dst;
+    unsigned char *src;
+    size_t size;
+    size_t iterations;
+};
+
+static double consumer_sample(void *arg)
+{
+    const struct consumer_sample *s = arg;
+    return measure_consumer(s->copy, s->flags, s->dst, s->src, s->size, s->iterations);
+}
+
+static void run_hint_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base, unsigned char *dst_base)
+{
+    static const struct
+    {
+        const char *name;
+        size_t size;
+    } sizes[] = {
+        {"L1   (16 KB)", 16 * 1024},
+        {"L2  (256 KB)", 256 * 1024},
+        {"L3    (4 MB)", 4 * 1024 * 1024},
+        {"DRAM (64 MB)", 64 * 1024 * 1024},
+    };
+    static const struct
+    {
+        const char *name;
+        int flags;
+    } hints[] = {
+        {"no hint     ", 0},
+        {"keep dst    ", MEMCPY_HINT_KEEP_DST},
+        {"stream dst  ", MEMCPY_HINT_STREAM_DST},
+        {"nta src     ", MEMCPY_HINT_NTA_SRC},
+        {"nta+stream  ", MEMCPY_HINT_NTA_SRC | MEMCPY_HINT_STREAM_DST},
+        {"demote dst  ", MEMCPY_HINT_DEMOTE_DST},
+    };
+    const hint_fn copy = MEMLIB_FN(hint_fn, memcpy_hint);
+
+#ifdef CPU_FEATURE_CLDEMOTE
+    const int demotes = cpu_has_feature(CPU_FEATURE_CLDEMOTE);
+#else
+    const int demotes = 0;
+#endif
+
+    printf("\n\nconsumer reads after memcpy_hint (GB/s read from dst, copy not timed%s):\n%s%s",
+           demotes ? "" : ", no cldemote here", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        /* each iteration is a copy and a read */
+        const size_t iterations = estimate_iterations(sizes[i].size, target_ns, expected_gbs) / 2 + 1;
+
+        printf("\n%s:", sizes[i].name);
+        for (size_t j = 0; j < sizeof(hints) / sizeof(hints[0]); j++)
+        {
+            struct consumer_sample s = {copy, hints[j].flags, dst_base + 64, src_base + 64, sizes[i].size,
+                                        iterations};
+            struct sample_stats sample;
+
+            if (sample_adaptive(consumer_sample, &s, &sample))
+                print_measurement(hints[j].name, &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", hints[j].name);
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef int (*policy_fn)(int policy);
+
+#define MIXED_COPY_SIZE (16 * 1024)
+#define MIXED_COMPUTE_STEPS 4096
+
+/* rounds of one copy followed by a block of scalar work, timing each part separately */
+static void run_mixed_rounds(stringop_fn copy, unsigned char *dst, unsigned char *src, size_t rounds,
+                             double *copy_gbs, double *compute_mops)
+{
+    const struct bench_buffers home = {dst, src, 0, 0};
+    struct bench_buffers buf;
+    struct timespec_portable t0, t1, t2;
+    double copy_s = 0, compute_s = 0;
+    uint64_t x = rounds;
+
+    for (size_t r = 0; r < rounds; r++)
+    {
+        if (copy)
+            place_buffers(&buf, &home, MIXED_COPY_SIZE);
+        get_monotonic_time(&t0);
+        if (copy)
+            copy(buf.dst, buf.src, MIXED_COPY_SIZE);
+        get_monotonic_time(&t1);
+        x = scalar_compute(x, MIXED_COMPUTE_STEPS);
+        get_monotonic_time(&t2);
+        if (copy)
+            release_buffers(&buf, &home, MIXED_COPY_SIZE);
+
+        copy_s += timespec_to_seconds(&t0, &t1);
+        compute_s += timespec_to_seconds(&t1, &t2);
+    }
+    compute_sink = x;
+
+    *copy_gbs = copy ? (double)rounds * MIXED_COPY_SIZE / copy_s / 1e9 : 0;
+    *compute_mops = (double)rounds * MIXED_COMPUTE_STEPS / compute_s / 1e6;
+}
+
+struct mixed_sample
+{
+    stringop_fn copy;
+    unsigned char *dst;
+    unsigned char *src;
+    size_t rounds;
+    struct side_samples copy_gbs;
+};
+
+static double mixed_sample(void *arg)
+{
+    struct mixed_sample *s = arg;
+    double copy_gbs, compute_mops;
+    run_mixed_rounds(s->copy, s->dst, s->src, s->rounds, &copy_gbs, &compute_mops);
+    add_side_sample(&s->copy_gbs, copy_gbs);
+    return compute_mops;
+}
+
+/* what the copies' vector width costs the code around them, when wide stores lower the core clock */
+static void run_mixed_table(uint64_t target_ns, unsigned char *src_base, unsigned char *dst_base)
+{
+    const policy_fn set_policy = MEMLIB_FN(policy_fn, memop_avx512_policy);
+    const struct
+    {
+        const char *name;
+        int policy;
+        int copies;
+    } rows[] = {
+        {"compute alone", -1, 0},
+        {"zmm policy  ", AVX512_POLICY_ZMM, 1},
+        {"ymm policy  ", AVX512_POLICY_YMM, 1},
+    };
+    /* a round is a few microseconds */
+    const size_t rounds = target_ns / SAMPLES_PER_TARGET / 5000 < 64 ? 64 : target_ns / SAMPLES_PER_TARGET / 5000;
+    const int previous = set_policy(-1);
+    double alone_mops = 0;
+
+    printf("\n\nmixed copy and scalar compute (%d KB memcpy, then %d dependent multiplies, per round; compute "
+           "Mop/s, then the copies' GB/s and the compute against running alone):\n",
+           MIXED_COPY_SIZE / 1024, MIXED_COMPUTE_STEPS);
+#ifdef FEAT_AVX512VL
+    if (!cpu_supports(FEAT_AVX512VL))
+#endif
+        printf("(no AVX-512VL here, so both policies run the same code)\n");
+    printf("%s" SEPARATOR, MOPS_HEADER);
+
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+    {
+        struct mixed_sample s = {rows[i].copies ? implementations[0].memcpy_fn : NULL, dst_base + 64,
+                                 src_base + 64, rounds, {{0}, 0}};
+        struct sample_stats sample;
+
+        if (rows[i].policy >= 0)
+            set_policy(rows[i].policy);
+
+        if (!sample_adaptive(mixed_sample, &s, &sample))
+        {
+            printf("\n            \t%s\t|    ERROR - no valid measurements.", rows[i].name);
+            continue;
+        }
+        print_measurement(rows[i].name, &sample);
+        if (!rows[i].copies)
+            alone_mops = sample.median;
+        else
+            printf("  %9.2f GB/s  %+7.1f%%", side_median(&s.copy_gbs),
+                   alone_mops > 0 ? (sample.median / alone_mops - 1.0) * 100.0 : 0.0);
+    }
+    printf("\n" SEPARATOR);
+
+    set_policy(previous);
+}
+
+/* the other code of the icache table: FOOTPRINT_FUNCTIONS functions of 64 bytes of multi-byte nops,
+ * called one after another, which streams more code through the front end than the L1 instruction
+ * cache and the uop cache hold while taking only a microsecond or two */
+#define FOOTPRINT_FUNCTIONS 1024
+#define FOOTPRINT_NOP_BYTES 64
+
+#define FOOTPRINT_4(X, p) X(p##0) X(p##1) X(p##2) X(p##3)
+#define FOOTPRINT_16(X, p) FOOTPRINT_4(X, p##0) FOOTPRINT_4(X, p##1) FOOTPRINT_4(X, p##2) FOOTPRINT_4(X, p##3)
+#define FOOTPRINT_64(X, p) FOOTPRINT_16(X, p##0) FOOTPRINT_16(X, p##1) FOOTPRINT_16(X, p##2) FOOTPRINT_16(X, p##3)
+#define FOOTPRINT_256(X, p) FOOTPRINT_64(X, p##0) FOOTPRINT_64(X, p##1) FOOTPRINT_64(X, p##2) FOOTPRINT_64(X, p##3)
+/* the names are octal literals, all different, so no two bodies are the same */
+#define FOOTPRINT_1024(X) FOOTPRINT_256(X, 00) FOOTPRINT_256(X, 01) FOOTPRINT_256(X, 02) FOOTPRINT_256(X, 03)
+
+#ifdef __aarch64__
+#define FOOTPRINT_NOPS ".rept 16\n\tnop\n\t.endr"
+#else
+#define FOOTPRINT_NOPS ".rept 8\n\t.byte 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00\n\t.endr"
+#endif
+
+#define FOOTPRINT_FN(n)                                 \
+    static NOINLINE uint64_t footprint_##n(uint64_t x)  \
+    {                                                   \
+        __asm__ __volatile__(FOOTPRINT_NOPS : "+r"(x)); \
+        return x + (n);                                 \
+    }
+#define FOOTPRINT_CALL(n) x = footprint_##n(x);
+
+FOOTPRINT_1024(FOOTPRINT_FN)
+
+static NOINLINE uint64_t footprint_pass(uint64_t x)
+{
+    FOOTPRINT_1024(FOOTPRINT_CALL)
+    return x;
+}
+
+static volatile uint64_t footprint_sink;
+
+/* each copy timed on its own, less the same timing around no copy at all, with a footprint pass
+ * before either when cold: what is left is what the copy costs once the footprint has evicted its
+ * code (and predictor state). Always on hot data, whatever --cache says */
+static double measure_icache(stringop_fn copy, unsigned char *dst, unsigned char *src, size_t size, size_t rounds,
+                             int cold)
+{
+    struct timespec_portable t0, t1;
+    double copies = 0, empty = 0;
+    uint64_t x = size;
+
+    for (size_t done = 0; done < rounds; done++)
+    {
+        if (cold)
+            x = footprint_pass(x);
+        get_monotonic_time(&t0);
+        copy(dst, src, size);
+        get_monotonic_time(&t1);
+        copies += timespec_to_seconds(&t0, &t1);
+
+        if (cold)
+            x = footprint_pass(x);
+        get_monotonic_time(&t0);
+        get_monotonic_time(&t1);
+        empty += timespec_to_seconds(&t0, &t1);
+    }
+    footprint_sink = x;
+    return copies > empty ? ((double)size * rounds) / ((copies - empty) * 1e9) : 0;
+}
+
+struct icache_sample
+{
+    stringop_fn copy;
+    unsigned char *dst;
+    unsigned char *src;
+    size_t size;
+    size_t rounds;
+    int cold;
+};
+
+static double icache_sample(void *arg)
+{
+    const struct icache_sample *s = arg;
+    return measure_icache(s->copy, s->dst, s->src, s->size, s->rounds, s->cold);
+}
+
+/* every implementation's small copies with their code hot, then each right after a footprint pass,
+ * for what its code size costs a program whose own code fills the front end; the ns per copy follow each row */
+static void run_icache_table(uint64_t target_ns, unsigned char *src_base, unsigned char *dst_base)
+{
+    static const size_t sizes[] = {32, 256, 2048};
+    /* a cold round is two passes, a few microseconds */
+    const size_t rounds = target_ns / SAMPLES_PER_TARGET / 4000 < 64 ? 64 : target_ns / SAMPLES_PER_TARGET / 4000;
+
+    printf("\n\nfront end pressure (each copy timed alone, hot, then after a pass over %d functions, %d KB of "
+           "other code):\n%s%s",
+           FOOTPRINT_FUNCTIONS, FOOTPRINT_FUNCTIONS * FOOTPRINT_NOP_BYTES / 1024, ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < num_implementations; i++)
+    {
+        printf("\n%s implementation:", implementations[i].name);
+        for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        {
+            for (int cold = 0; cold < 2; cold++)
+            {
+                struct icache_sample s = {implementations[i].memcpy_fn, dst_base + 64, src_base + 64, sizes[j],
+                                          cold ? rounds : rounds * 16, cold};
+                struct sample_stats sample;
+                char name[32];
+
+                snprintf(name, sizeof(name), "%4zu B %-5s", sizes[j], cold ? "cold" : "hot");
+                if (sample_adaptive(icache_sample, &s, &sample))
+                {
+                    print_measurement(name, &sample);
+                    printf("  %7.1f ns", sizes[j] / sample.median);
+                }
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+            }
+        }
+    }
+    printf("\n" SEPARATOR);
+}
+
+/* copies into memory nothing has touched yet, page faults included, against the same copy into
+ * flushed but mapped memory; always in fresh mode, whatever --cache says */
+static void run_fault_table(const size_t *sizes, size_t num_sizes, uint64_t target_ns, double expected_gbs,
+                            unsigned char *src_base, unsigned char *dst_base)
+{
+    const struct
+    {
+        const char *name;
+        stringop_fn fn;
+        enum cache_mode mode;
+    } rows[] = {
+        {"our         ", implementations[0].memcpy_fn, CACHE_FRESH},
+        {"stdlib      ", implementations[1].memcpy_fn, CACHE_FRESH},
+        {"prefault    ", MEMLIB_FN(stringop_fn, memcpy_prefault), CACHE_FRESH},
+        {"our, mapped ", implementations[0].memcpy_fn, CACHE_COLD},
+    };
+    const enum cache_mode previous = cache_mode;
+
+    printf("\n\nfirst touch copies (into fresh mappings, faults included):\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+        const size_t iterations = estimate_iterations(sizes[i], target_ns, expected_gbs);
+
+        printf("\n%7.2f MB: ", sizes[i] / (1024.0 * 1024.0));
+        for (size_t j = 0; j < sizeof(rows) / sizeof(rows[0]); j++)
+        {
+            struct sample_stats sample;
+
+            cache_mode = rows[j].mode;
+            if (sample_throughput(dst_base + 64, src_base + 64, sizes[i], iterations, rows[j].fn, &sample))
+                print_measurement(rows[j].name, &sample);
+            else
+                printf("\n            \t%s\t|    ERROR - no valid measurements.", rows[j].name);
+        }
+        printf("\n" SEPARATOR);
+    }
+    cache_mode = previous;
+}
+
+/* one thread fills src, then hands it to the measuring thread to copy out */
+struct handoff
+{
+    unsigned char *src;
+    size_t size;
+    int cpu; /* the producer's, or -1 to fill src on the measuring thread itself */
+    __attribute__((aligned(64))) int ready;
+    int stop;
+};
+
+static void wait_for_flag(int *flag, int value, int *stop)
+{
+    for (unsigned int spins = 0; __atomic_load_n(flag, __ATOMIC_ACQUIRE) != value; spins++)
+    {
+        if (stop && __atomic_load_n(stop, __ATOMIC_ACQUIRE))
+            return;
+        /* pinned to one cpu with nobody to hand off to, or just preempted */
+        if (spins < (1u << 16))
+#ifdef __aarch64__
+            __asm__ __volatile__("yield");
+#else
+            __builtin_ia32_pause();
+#endif
+        else
+            yield_thread();
+    }
+}
+
+/* plain stores of a new value each round, leaving every line of src dirty in the writer's cache */
+static void fill_round(unsigned char *p, size_t n, uint64_t round)
+{
+    const uint64_t value = round * 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i + 8 <= n; i += 8)
+        memcpy(p + i, &value, 8);
+}
+
+static void handoff_producer(void *arg)
+{
+    struct handoff *h = arg;
+
+    pin_thread(h->cpu);
+    for (uint64_t round = 1;; round++)
+    {
+        wait_for_flag(&h->ready, 0, &h->stop);
+        if (__atomic_load_n(&h->stop, __ATOMIC_ACQUIRE))
+            return;
+        fill_round(h->src, h->size, round);
+        __atomic_store_n(&h->ready, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* GB/s of the copies alone, less the cost of reading the clock around each */
+static double measure_handoff(struct handoff *h, stringop_fn copy, unsigned char *dst, size_t iterations,
+                              double clock_s, uint64_t budget_ns)
+{
+    struct timespec_portable pass_start, start, end;
+    double elapsed = 0;
+    size_t done = 0;
+
+    get_monotonic_time(&pass_start);
+    while (done < iterations)
+    {
+        if (h->cpu < 0)
+            fill_round(h->src, h->size, done + 1);
+        else
+            wait_for_flag(&h->ready, 1, NULL);
+
+        get_monotonic_time(&start);
+        copy(dst, h->src, h->size);
+        get_monotonic_time(&end);
+        elapsed += timespec_to_seconds(&start, &end) - clock_s;
+
+        __atomic_store_n(&h->ready, 0, __ATOMIC_RELEASE);
+        if (++done >= 4 && timespec_to_seconds(&pass_start, &end) * 1e9 > budget_ns)
+            break;
+    }
+    return elapsed > 0 ? ((double)h->size * done) / (elapsed * 1e9) : 0;
+}
+
+struct handoff_sample
+{
+    struct handoff *h;
+    stringop_fn copy;
+    unsigned char *dst;
+    size_t iterations;
+    double clock_s;
+    uint64_t budget_ns;
+};
+
+static double handoff_sample(void *arg)
+{
+    const struct handoff_sample *s = arg;
+    return measure_handoff(s->h, s->copy, s->dst, s->iterations, s->clock_s, s->budget_ns);
+}
+
+static void format_size(char *buf, size_t len, size_t size)
+{
+    if (size >= 1024 * 1024)
+        snprintf(buf, len, "%zu MB", size >> 20);
+    else if (size >= 1024)
+        snprintf(buf, len, "%zu KB", size >> 10);
+    else
+        snprintf(buf, len, "%zu B", size);
+}
+
+typedef size_t (*cache_size_fn)(int level);
+
+/* copies of data that another thread has just written, from its L1 on the same core, from another
+ * core's L2, or across sockets, up to the size of the last level cache */
+static void run_handoff_table(uint64_t target_ns, double expected_gbs, unsigned char *src_base,
+                              unsigned char *dst_base)
+{
+    enum
+    {
+        PAIR_SELF,
+        PAIR_SMT,
+        PAIR_CORE,
+        PAIR_SOCKET,
+        PAIR_COUNT
+    };
+    static const char *const pair_names[PAIR_COUNT] = {"self  ", "smt   ", "core  ", "socket"};
+    int producer[PAIR_COUNT] = {-1, -1, -1, -1};
+    const int consumer = bench_cpu;
+    int consumer_package = 0, consumer_core = 0;
+    const size_t llc_size = MEMLIB_FN(cache_size_fn, membase_cache_size)(0);
+
+    /* the consumer is this thread, already pinned; producers come from what the process was allowed */
+    cpu_topology(consumer, &consumer_package, &consumer_core);
+    for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++)
+    {
+        int package, core;
+        if (cpu == consumer || !affinity_has(&process_affinity, cpu) || !cpu_topology(cpu, &package, &core))
+            continue;
+        const int pair = package != consumer_package ? PAIR_SOCKET : core == consumer_core ? PAIR_SMT : PAIR_CORE;
+        if (producer[pair] < 0)
+            producer[pair] = cpu;
+    }
+
+    /* the clock's own cost, taken off every copy */
+    struct timespec_portable start, end;
+    double clock_s = 1;
+    for (int i = 0; i < 1000; i++)
+    {
+        get_monotonic_time(&start);
+        get_monotonic_time(&end);
+        if (timespec_to_seconds(&start, &end) < clock_s)
+            clock_s = timespec_to_seconds(&start, &end);
+    }
+
+    printf("\n\ncopies of data just written by another thread (consumer on cpu %d", consumer);
+    for (int pair = PAIR_SMT; pair < PAIR_COUNT; pair++)
+    {
+        if (producer[pair] >= 0)
+            printf(", %s on %d", pair_names[pair], producer[pair]);
+    }
+    printf("):\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+    for (size_t size = 64; size <= llc_size; size *= 4)
+    {
+        const size_t iterations = estimate_iterations(size, target_ns, expected_gbs);
+        char size_name[32];
+
+        format_size(size_name, sizeof(size_name), size);
+        printf("\n%s:", size_name);
+        for (int pair = 0; pair < PAIR_COUNT; pair++)
+        {
+            for (size_t impl = 0; impl < 2; impl++)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "%s %-5s", pair_names[pair], impl ? "std" : "our");
+
+                if (pair != PAIR_SELF && producer[pair] < 0)
+                {
+                    printf("\n            \t%s\t|    n/a", name);
+                    continue;
+                }
+
+                struct handoff h = {src_base + 64, size, pair == PAIR_SELF ? -1 : producer[pair], 0, 0};
+                bench_thread thread;
+                if (h.cpu >= 0 && !start_thread(&thread, handoff_producer, &h))
+                {
+                    printf("\n            \t%s\t|    ERROR - no producer thread.", name);
+                    continue;
+                }
+
+                struct handoff_sample s = {&h, implementations[impl].memcpy_fn, dst_base + 64, iterations + 1,
+                                           clock_s, placed_pass_ns};
+                struct sample_stats sample;
+                const int valid = sample_adaptive(handoff_sample, &s, &sample);
+
+                if (h.cpu >= 0)
+                {
+                    __atomic_store_n(&h.stop, 1, __ATOMIC_RELEASE);
+                    join_thread(thread);
+                }
+                if (valid)
+                    print_measurement(name, &sample);
+                else
+                    printf("\n            \t%s\t|    ERROR - no valid measurements.", name);
+            }
+        }
+        printf("\n" SEPARATOR);
+    }
+}
+
+typedef memcpy_handle (*async_fn)(void *dst, const void *src, size_t n);
+typedef int (*async_test_fn)(memcpy_handle handle);
+typedef void (*async_wait_fn)(memcpy_handle handle);
+
+#define ASYNC_COPY_SIZE (64 * 1024 * 1024)
+
+/* a copy and blocks of scalar work, one after the other, or with the copy handed to memcpy_async()
+ * and polled between the blocks; the copy is timed until it is seen done */
+static void run_async_round(stringop_fn copy, async_fn submit, async_test_fn test, async_wait_fn wait,
+                            unsigned char *dst, unsigned char *src, size_t blocks, double *round_s, double *copy_s)
+{
+    const struct bench_buffers home = {dst, src, 0, 0};
+    struct bench_buffers buf;
+    struct timespec_portable start, now;
+    memcpy_handle handle = 0;
+    int pending = 0;
+    uint64_t x = blocks;
+
+    if (copy || submit)
+        place_buffers(&buf, &home, ASYNC_COPY_SIZE);
+    get_monotonic_time(&start);
+    if (submit)
+    {
+        handle = submit(buf.dst, buf.src, ASYNC_COPY_SIZE);
+        pending = 1;
+    }
+    else if (copy)
+        copy(buf.dst, buf.src, ASYNC_COPY_SIZE);
+    get_monotonic_time(&now);
+    *copy_s = timespec_to_seconds(&start, &now);
+
+    for (size_t b = 0; b < blocks; b++)
+    {
+        x = scalar_compute(x, MIXED_COMPUTE_STEPS);
+        if (pending && test(handle))
+        {
+            get_monotonic_time(&now);
+            *copy_s = timespec_to_seconds(&start, &now);
+            pending = 0;
+        }
+    }
+    if (pending)
+    {
+        wait(handle);
+        get_monotonic_time(&now);
+        *copy_s = timespec_to_seconds(&start, &now);
+    }
+    get_monotonic_time(&now);
+    *round_s = timespec_to_seconds(&start, &now);
+    if (copy || submit)
+        release_buffers(&buf, &home, ASYNC_COPY_SIZE);
+    compute_sink = x;
+}
+
+struct async_sample
+{
+    stringop_fn copy;
+    async_fn submit;
+    async_test_fn test;
+    async_wait_fn wait;
+    unsigned char *dst;
+    unsigned char *src;
+    size_t blocks;
+    size_t rounds;
+    struct side_samples copy_gbs;
+};
+
+static double async_sample(void *arg)
+{
+    struct async_sample *s = arg;
+    double round_total = 0, copy_total = 0;
+
+    for (size_t r = 0; r < s->rounds; r++)
+    {
+        double round_s, copy_s;
+        run_async_round(s->copy, s->submit, s->test, s->wait, s->dst, s->src, s->blocks, &round_s, &copy_s);
+        round_total += round_s;
+        copy_total += copy_s;
+    }
+    if (s->copy || s->submit)
+        add_side_sample(&s->copy_gbs, (double)s->rounds * ASYNC_COPY_SIZE / copy_total / 1e9);
+    return (double)s->rounds * s->blocks * MIXED_COMPUTE_STEPS / round_total / 1e6;
+}
+
+/* how much of a big copy's time memcpy_async() gives back to the caller's own work */
+static void run_async_table(uint64_t target_ns, unsigned char *src_base, unsigned char *dst_base)
+{
+    const async_fn submit = MEMLIB_FN(async_fn, memcpy_async);
+    const async_test_fn test = MEMLIB_FN(async_test_fn, memcpy_test);
+    const async_wait_fn wait = MEMLIB_FN(async_wait_fn, memcpy_wait);
+    const stringop_fn copy = implementations[0].memcpy_fn;
+    const struct
+    {
+        const char *name;
+        int mode;
+    } rows[] = {
+        {"compute alone", 0},
+        {"memcpy, compute", 1},
+        {"async + compute", 2},
+    };
+    double round_s, copy_s, block_s;
+
+    /* the copy thread starts on the first queued memcpy_async() and inherits this thread's affinity,
+     * which must not be the one cpu the benchmark is pinned to; small copies never queue */
+    set_affinity(&process_affinity);
+    wait(submit(dst_base + 64, src_base + 64, 1024 * 1024));
+    pin_thread(bench_cpu);
+
+    /* about as much scalar work as the copy takes by itself */
+    run_async_round(copy, NULL, NULL, NULL, dst_base + 64, src_base + 64, 0, &round_s, &copy_s);
+    run_async_round(copy, NULL, NULL, NULL, dst_base + 64, src_base + 64, 0, &round_s, &copy_s);
+    run_async_round(NULL, NULL, NULL, NULL, dst_base + 64, src_base + 64, 64, &block_s, &round_s);
+    block_s /= 64;
+    const size_t blocks = copy_s / block_s < 1 ? 1 : (size_t)(copy_s / block_s);
+    const double sample_rounds = target_ns / SAMPLES_PER_TARGET / (copy_s * 1e9);
+    const size_t rounds = sample_rounds < 1 ? 1 : (size_t)sample_rounds;
+    double sync_mops = 0;
+
+    printf("\n\n%d MB copy overlapped with %zu blocks of %d dependent multiplies (compute Mop/s over the whole "
+           "round, then the copy's GB/s until it was seen done and the round against memcpy's):\n",
+           ASYNC_COPY_SIZE >> 20, blocks, MIXED_COMPUTE_STEPS);
+    printf("%s" SEPARATOR, MOPS_HEADER);
+
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+    {
+        struct async_sample s = {rows[i].mode == 1 ? copy : NULL, rows[i].mode == 2 ? submit : NULL, test, wait,
+                                 dst_base + 64, src_base + 64, blocks, rounds, {{0}, 0}};
+        struct sample_stats sample;
+
+        if (!sample_adaptive(async_sample, &s, &sample))
+        {
+            printf("\n            \t%s\t|    ERROR - no valid measurements.", rows[i].name);
+            continue;
+        }
+        print_measurement(rows[i].name, &sample);
+        if (rows[i].mode == 1)
+        {
+            sync_mops = sample.median;
+            printf("  %9.2f GB/s", side_median(&s.copy_gbs));
+        }
+        else if (rows[i].mode == 2)
+            printf("  %9.2f GB/s  %+7.1f%%", side_median(&s.copy_gbs),
+                   sync_mops > 0 ? (sample.median / sync_mops - 1.0) * 100.0 : 0.0);
+    }
+    printf("\n" SEPARATOR);
+}
+
+/* the geometric mean of a's medians over the cases both a and b measured, and a's speed relative
+ * to b's with a 95% interval: the mean log ratio, each case adding the variance of both medians */
+static int compare_perf_stats(const struct perf_stats *a, const struct perf_stats *b, double *mean_gbs, double *ratio,
+                              double *low, double *high)
+{
+    double log_sum = 0, log_ratio_sum = 0, variance = 0;
+    size_t pairs = 0;
+
+    for (size_t k = 0; k < a->count && k < b->count; k++)
+    {
+        if (a->median_gbs[k] <= 0 || b->median_gbs[k] <= 0)
+            continue;
+        log_sum += log(a->median_gbs[k]);
+        log_ratio_sum += log(a->median_gbs[k] / b->median_gbs[k]);
+        variance += a->log_se[k] * a->log_se[k] + b->log_se[k] * b->log_se[k];
+        pairs++;
+    }
+    if (!pairs)
+        return 0;
+
+    const double mean_log_ratio = log_ratio_sum / pairs;
+    const double margin = 1.96 * sqrt(variance) / pairs;
+    *mean_gbs = exp(log_sum / pairs);
+    *ratio = exp(mean_log_ratio);
+    *low = exp(mean_log_ratio - margin);
+    *high = exp(mean_log_ratio + margin);
+    return 1;
+}
+
+/* every implementation against every summary category, then against the baseline */
+static void print_summary(void)
+{
+    static const char *const categories[] = {"memcpy aligned", "memcpy unaligned", "memmove forward",
+                                             "memmove backward"};
+    const struct implementation *base = &implementations[baseline];
+
+    for (int matrix = 0; matrix < 2; matrix++)
+    {
+        if (!matrix)
+            printf("\nperformance summary (geometric means of the medians, GB/s):\n");
+        else
+            printf("\nrelative to %s (95%% CI):\n", base->name);
+        printf("%-32s|", "implementation");
+        for (int c = 0; c < 4; c++)
+            printf(matrix ? " %-22s" : " %-17s", categories[c]);
+        printf("\n" SEPARATOR);
+
+        for (size_t i = 0; i < num_implementations; i++)
+        {
+            const struct implementation *impl = &implementations[i];
+            const struct perf_stats *ours[] = {&impl->results.memcpy_aligned, &impl->results.memcpy_unaligned,
+                                               &impl->results.memmove_forward, &impl->results.memmove_backward};
+            const struct perf_stats *theirs[] = {&base->results.memcpy_aligned, &base->results.memcpy_unaligned,
+                                                 &base->results.memmove_forward, &base->results.memmove_backward};
+
+            if (matrix && i == baseline)
+                continue;
+            printf("%-32.32s|", impl->name);
+            for (int c = 0; c < 4; c++)
+            {
+                double mean_gbs, ratio, low, high;
+
+                /* against itself for the GB/s, so that it doesn't depend on what the baseline measured */
+                if (!compare_perf_stats(ours[c], matrix ? theirs[c] : ours[c], &mean_gbs, &ratio, &low, &high))
+                    printf(matrix ? " %-22s" : " %-17s", "-");
+                else if (!matrix)
+                    printf(" %-17.2f", mean_gbs);
+                else
+                    printf(" %6.1f%% [%5.1f, %5.1f]", ratio * 100, low * 100, high * 100);
+            }
+            printf("\n");
+        }
+    }
+    printf("\n");
+}
+
+typedef int (*stats_snapshot_fn)(struct membase_stats *stats);
+
+/* what our library had counted when the last table ended */
+static struct membase_stats stats_mark;
+
+/* in a MEMBASE_STATS build of the library, how it went about the calls of the table that just ran;
+ * with table NULL only takes the starting point */
+static void print_library_stats(const char *table)
+{
+#ifdef __aarch64__
+    static const char *const tier_names[MEMBASE_TIER_COUNT] = {"scalar", "neon", "sve"};
+#else
+    static const char *const tier_names[MEMBASE_TIER_COUNT] = {"scalar", "sse2", "avx2", "avx512", "avx512vl"};
+#endif
+    struct membase_stats now;
+
+    if (!MEMLIB_FN(stats_snapshot_fn, membase_stats_snapshot)(&now))
+        return;
+    if (!table)
+    {
+        stats_mark = now;
+        return;
+    }
+
+    /* every counter only grows, so the table's share is a field by field difference */
+    struct membase_stats delta = now;
+    uint64_t *counter = (uint64_t *)&delta;
+    const uint64_t *mark = (const uint64_t *)&stats_mark;
+    uint64_t any = 0;
+    for (size_t i = 0; i < sizeof(delta) / sizeof(uint64_t); i++)
+    {
+        counter[i] -= mark[i];
+        any |= counter[i];
+    }
+    stats_mark = now;
+    if (!any)
+        return;
+
+    printf("\nlibrary stats for the %s table:\n", table);
+    printf("%-32s|      calls        MB   cycles/call\n" SEPARATOR, "memcpy_local/memmove_local n");
+    for (int b = 0; b < MEMBASE_STATS_BUCKETS; b++)
+    {
+        char size_name[32], label[40];
+
+        if (!delta.calls[b])
+            continue;
+        format_size(size_name, sizeof(size_name), (size_t)1 << (b < 63 ? b : 63));
+        snprintf(label, sizeof(label), "below %s", size_name);
+        if (delta.cycles[b])
+            printf("%-32s| %10llu %9.2f %13.1f\n", label, (unsigned long long)delta.calls[b], delta.bytes[b] / 1e6,
+                   (double)delta.cycles[b] / delta.calls[b]);
+        else
+            printf("%-32s| %10llu %9.2f %13s\n", label, (unsigned long long)delta.calls[b], delta.bytes[b] / 1e6, "-");
+    }
+
+    printf("kernel runs:");
+    for (int t = 0; t < MEMBASE_TIER_COUNT; t++)
+        printf(" %s %llu,", tier_names[t], (unsigned long long)delta.tiers[t]);
+    printf(" cached %llu (%.2f MB), streaming %llu (%.2f MB), reversed for 4K aliasing %llu\n",
+           (unsigned long long)delta.cached, delta.cached_bytes / 1e6, (unsigned long long)delta.streaming,
+           delta.streaming_bytes / 1e6, (unsigned long long)delta.alias_reversed);
+    printf("memmove: same %llu, disjoint %llu, forward %llu, backward %llu (split %llu), close to 4K aliasing %llu\n",
+           (unsigned long long)delta.memmove_same, (unsigned long long)delta.memmove_disjoint,
+           (unsigned long long)delta.memmove_forward, (unsigned long long)delta.memmove_backward,
+           (unsigned long long)delta.memmove_split, (unsigned long long)delta.memmove_ahead);
+    printf(SEPARATOR);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct test_case alignment_cases[] = {
+        {"aligned    ", {.src_align = 64, .dst_align = 64}},
+        {"src+1      ", {.src_align = 65, .dst_align = 64}},
+        {"dst+1      ", {.src_align = 64, .dst_align = 65}},
+        {"both+1     ", {.src_align = 65, .dst_align = 65}},
+        {"worst-case ", {.src_align = 63, .dst_align = 63}}};
+
+    struct test_case memmove_cases[] = {
+        {"forward     ", {.overlap_offset = 0, .backwards = 0}},
+        {"back 25%    ", {.overlap_offset = 0, .backwards = 1}},
+        {"back 50%    ", {.overlap_offset = 0, .backwards = 1}},
+        {"back 75%    ", {.overlap_offset = 0, .backwards = 1}},
+        {"back 1-byte ", {.overlap_offset = 0, .backwards = 1}}};
+
+    /* dst - src distances modulo a page, for the 4k-aliasing sweep */
+    static const size_t alias_offsets[] = {0, 1, 16, 64, 128, 192, 255, 256, 512, 1024, 2048, 3072, 4032, 4095};
+    static char alias_names[sizeof(alias_offsets) / sizeof(alias_offsets[0])][16];
+    struct test_case alias_cases[sizeof(alias_offsets) / sizeof(alias_offsets[0])];
+
+    for (size_t i = 0; i < sizeof(alias_offsets) / sizeof(alias_offsets[0]); i++)
+    {
+        snprintf(alias_names[i], sizeof(alias_names[i]), "+%-11zu", alias_offsets[i]);
+        alias_cases[i] = (struct test_case){alias_names[i], {.src_align = 64, .dst_align = 64 + alias_offsets[i]}};
+    }
+
+    static const size_t bench_sizes[] = {
+        64 * 1024,        /* 64KB - ~L1 cache size */
+        256 * 1024,       /* 256KB - ~L2 cache size */
+        2 * 1024 * 1024,  /* 2MB - ~L3 cache size */
+        16 * 1024 * 1024, /* 16MB - out of cache */
+        64 * 1024 * 1024, /* 64MB */
+    };
+    uint64_t target_duration_ns = DEFAULT_TEST_DURATION_NS;
+    double expected_gbs = 0.0;
+    int cpu_given = 0;
+    const char *baseline_name = "stdlib";
+
+    add_implementation("our", MEMLIB_FN(stringop_fn, memcpy_local), MEMLIB_FN(stringop_fn, memmove_local));
+    add_implementation("stdlib", STDLIB_FN(stringop_fn, memcpy), STDLIB_FN(stringop_fn, memmove));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--duration=", 11) == 0)
+        {
+            double ms = strtod(argv[i] + 11, NULL);
             if (ms > 0)
             {
                 target_duration_ns = (uint64_t)(ms * 1e6);
@@ -363,14 +3158,88 @@ int main(int argc, char **argv)
         {
             expected_gbs = strtod(argv[i] + 15, NULL);
         }
+        else if (strncmp(argv[i], "--tables=", 9) == 0)
+        {
+            selected_tables = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--impl=", 7) == 0)
+        {
+            register_implementation(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            profile_path = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+        {
+            baseline_name = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--ci=", 5) == 0)
+        {
+            double percent = strtod(argv[i] + 5, NULL);
+            if (percent > 0)
+                ci_target = percent / 100;
+        }
+        else if (strncmp(argv[i], "--cpu=", 6) == 0)
+        {
+            bench_cpu = atoi(argv[i] + 6);
+            cpu_given = 1;
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0)
+        {
+            if (strcmp(argv[i] + 8, "hot") == 0)
+                cache_mode = CACHE_HOT;
+            else if (strcmp(argv[i] + 8, "cold") == 0)
+                cache_mode = CACHE_COLD;
+            else if (strcmp(argv[i] + 8, "rotate") == 0)
+                cache_mode = CACHE_ROTATE;
+            else if (strcmp(argv[i] + 8, "fresh") == 0)
+                cache_mode = CACHE_FRESH;
+            else
+            {
+                printf("unknown cache mode %s, expected hot, cold, rotate or fresh.\n", argv[i] + 8);
+                return 1;
+            }
+        }
+    }
+    for (baseline = 0; baseline < num_implementations; baseline++)
+    {
+        if (strcmp(implementations[baseline].name, baseline_name) == 0)
+            break;
+    }
+    if (baseline == num_implementations)
+    {
+        printf("no implementation called %s to use as the baseline.\n", baseline_name);
+        return 1;
+    }
+    for (size_t i = 0; i < num_implementations; i++)
+        init_test_results(&implementations[i].results);
+
+    placed_pass_ns = target_duration_ns / 20;
+    sample_budget_ns = target_duration_ns * 2;
+
+    /* one cpu for the whole run, so that the scheduler moving us can't show up as noise */
+    get_affinity(&process_affinity);
+    if (!cpu_given)
+    {
+        while (bench_cpu < AFFINITY_MAX_CPUS - 1 && !affinity_has(&process_affinity, bench_cpu))
+            bench_cpu++;
+    }
+    if (bench_cpu < 0 || bench_cpu >= AFFINITY_MAX_CPUS || !affinity_has(&process_affinity, bench_cpu) ||
+        !pin_thread(bench_cpu))
+    {
+        printf("can't run on cpu %d.\n", bench_cpu);
+        return 1;
     }
 
-    printf("\nrunning benchmarks (target duration: %.1f ms)...\n\n",
-           target_duration_ns / 1e6);
+    static const char *const cache_mode_names[] = {"hot", "cold", "rotate", "fresh"};
+    printf("\nrunning benchmarks (target duration: %.1f ms, %s cache, cpu %d, median to +-%.1f%%)...\n\n",
+           target_duration_ns / 1e6, cache_mode_names[cache_mode], bench_cpu, ci_target * 100);
 
     size_t max_size = bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1];
-    unsigned char *src_base = __aligned_alloc(64, max_size * 2 + 256);
-    unsigned char *dst_base = __aligned_alloc(64, max_size * 2 + 256);
+    /* page aligned, so that the test case offsets are also offsets within a page */
+    unsigned char *src_base = __aligned_alloc(4096, max_size * 2 + 8192);
+    unsigned char *dst_base = __aligned_alloc(4096, max_size * 2 + 8192);
 
     if (!src_base || !dst_base)
     {
@@ -378,96 +3247,213 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    printf("memcpy alignment tests:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
-
-    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    home_src_base = src_base;
+    home_dst_base = dst_base;
+    home_size = max_size * 2 + 8192;
+    if (cache_mode == CACHE_ROTATE && !setup_rotate_pools())
     {
-        size_t size = bench_sizes[i];
-        size_t iterations = estimate_iterations(size, target_duration_ns, expected_gbs);
+        printf("failed to allocate the rotate mode buffer pools.\n");
+        return 1;
+    }
+    print_library_stats(NULL);
 
-        printf("\n%7.2f MB: ", size / (1024.0 * 1024.0));
+    if (table_enabled("memcpy"))
+    {
+        printf("memcpy alignment tests:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
 
-        for (size_t impl = 0; impl < 2; impl++)
+        for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
         {
-            run_test_cases(alignment_cases,
-                           sizeof(alignment_cases) / sizeof(alignment_cases[0]),
-                           size, iterations, src_base, dst_base,
-                           &implementations[impl], 0);
+            size_t size = bench_sizes[i];
+            size_t iterations = estimate_iterations(size, target_duration_ns, expected_gbs);
+
+            printf("\n%7.2f MB: ", size / (1024.0 * 1024.0));
+
+            for (size_t impl = 0; impl < num_implementations; impl++)
+            {
+                run_test_cases(alignment_cases,
+                               sizeof(alignment_cases) / sizeof(alignment_cases[0]),
+                               size, iterations, src_base, dst_base,
+                               &implementations[impl], TEST_MEMCPY);
+            }
         }
+        print_library_stats("memcpy");
     }
 
-    printf("\n\nmemmove overlap tests:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
-
-    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    if (table_enabled("memmove"))
     {
-        size_t size = bench_sizes[i];
-        size_t iterations = estimate_iterations(size, target_duration_ns, expected_gbs);
+        printf("\n\nmemmove overlap tests:\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
+
+        for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+        {
+            size_t size = bench_sizes[i];
+            size_t iterations = estimate_iterations(size, target_duration_ns, expected_gbs);
+
+            printf("\n%7.2f MB: ", size / (1024.0 * 1024.0));
+
+            for (size_t impl = 0; impl < num_implementations; impl++)
+            {
+                if (!implementations[impl].memmove_fn)
+                    continue;
+
+                /* calc overlaps based on current test size */
+                memmove_cases[1].overlap_offset = size * 3 / 4; /* 25% back = 75% overlap */
+                memmove_cases[2].overlap_offset = size / 2;     /* 50% back = 50% overlap */
+                memmove_cases[3].overlap_offset = size / 4;     /* 75% back = 25% overlap */
+                memmove_cases[4].overlap_offset = size - 1;     /* 1 byte from end */
+
+                run_test_cases(memmove_cases,
+                               sizeof(memmove_cases) / sizeof(memmove_cases[0]),
+                               size, iterations, src_base, dst_base,
+                               &implementations[impl], TEST_MEMMOVE);
+            }
+        }
+        print_library_stats("memmove");
+    }
 
-        printf("\n%7.2f MB: ", size / (1024.0 * 1024.0));
+    if (table_enabled("alias"))
+    {
+        printf("\n\nmemcpy 4k-aliasing sweep (dst - src mod 4096):\n%s%s", ALIGNMENT_HEADER, SEPARATOR);
 
-        for (size_t impl = 0; impl < 2; impl++)
+        /* the effect is limited to what the store buffer can hold in flight, so cached sizes only */
+        for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]) && bench_sizes[i] <= 2 * 1024 * 1024; i++)
         {
-            /* calc overlaps based on current test size */
-            memmove_cases[1].overlap_offset = size * 3 / 4; /* 25% back = 75% overlap */
-            memmove_cases[2].overlap_offset = size / 2;     /* 50% back = 50% overlap */
-            memmove_cases[3].overlap_offset = size / 4;     /* 75% back = 25% overlap */
-            memmove_cases[4].overlap_offset = size - 1;     /* 1 byte from end */
+            size_t size = bench_sizes[i];
+            size_t iterations = estimate_iterations(size, target_duration_ns, expected_gbs);
+
+            printf("\n%7.2f MB: ", size / (1024.0 * 1024.0));
 
-            run_test_cases(memmove_cases,
-                           sizeof(memmove_cases) / sizeof(memmove_cases[0]),
-                           size, iterations, src_base, dst_base,
-                           &implementations[impl], 1);
+            for (size_t impl = 0; impl < num_implementations; impl++)
+            {
+                run_test_cases(alias_cases,
+                               sizeof(alias_cases) / sizeof(alias_cases[0]),
+                               size, iterations, src_base, dst_base,
+                               &implementations[impl], TEST_ALIAS_SWEEP);
+            }
         }
+        print_library_stats("alias");
     }
 
-    printf("\nperformance summary:\n");
-    printf("==================================================================\n");
-    printf("relative performance (ours vs stdlib):\n");
-    printf("  \t\t\t\t|  avg GB/s   min GB/s   max GB/s   vs stdlib\n");
-    printf(SEPARATOR);
+    if (table_enabled("tile"))
+    {
+        run_tile_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("tile");
+    }
 
-    const char *categories[] = {
-        "memcpy (aligned)   ",
-        "memcpy (unaligned) ",
-        "memmove (forward)  ",
-        "memmove (backward) "};
+    if (table_enabled("bswap"))
+    {
+        run_bswap_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("bswap");
+    }
 
-    struct perf_stats *custom_stats[] = {
-        &implementations[0].results.memcpy_aligned,
-        &implementations[0].results.memcpy_unaligned,
-        &implementations[0].results.memmove_forward,
-        &implementations[0].results.memmove_backward};
+    if (table_enabled("scan"))
+    {
+        run_scan_table(bench_sizes, sizeof(bench_sizes) / sizeof(bench_sizes[0]), target_duration_ns,
+                       expected_gbs, src_base);
+        print_library_stats("scan");
+    }
 
-    struct perf_stats *stdlib_stats[] = {
-        &implementations[1].results.memcpy_aligned,
-        &implementations[1].results.memcpy_unaligned,
-        &implementations[1].results.memmove_forward,
-        &implementations[1].results.memmove_backward};
+    if (table_enabled("pad"))
+    {
+        run_pad_table(bench_sizes, sizeof(bench_sizes) / sizeof(bench_sizes[0]), target_duration_ns,
+                      expected_gbs, src_base, dst_base);
+        print_library_stats("pad");
+    }
 
-    for (int i = 0; i < 4; i++)
+    if (table_enabled("persist"))
     {
-        if (custom_stats[i]->count == 0 || stdlib_stats[i]->count == 0)
-            continue;
+        run_persist_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("persist");
+    }
 
-        double custom_avg = custom_stats[i]->total_gb / custom_stats[i]->count;
-        double stdlib_avg = stdlib_stats[i]->total_gb / stdlib_stats[i]->count;
-        double ratio = custom_avg / stdlib_avg * 100.0;
+    if (table_enabled("delta"))
+    {
+        run_delta_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("delta");
+    }
 
-        printf("  \t%s\t| %8.2f   %8.2f   %8.2f   %6.1f%%\n",
-               categories[i],
-               custom_avg,
-               custom_stats[i]->min_gb,
-               custom_stats[i]->max_gb,
-               ratio);
+    if (table_enabled("sparse"))
+    {
+        run_sparse_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("sparse");
     }
 
-    printf("\n");
+    if (table_enabled("rotate"))
+    {
+        run_rotate_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("rotate");
+    }
+
+    if (table_enabled("gather"))
+    {
+        run_gather_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("gather");
+    }
+
+    /* only with a histogram to replay, or when asked for by name */
+    if (table_enabled("profile") && (profile_path || selected_tables))
+    {
+        run_profile_table(target_duration_ns, expected_gbs, src_base, dst_base, max_size * 2 + 8192);
+        print_library_stats("profile");
+    }
+
+    if (table_enabled("hint"))
+    {
+        run_hint_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("hint");
+    }
+
+    if (table_enabled("mixed"))
+    {
+        run_mixed_table(target_duration_ns, src_base, dst_base);
+        print_library_stats("mixed");
+    }
+
+    if (table_enabled("icache"))
+    {
+        run_icache_table(target_duration_ns, src_base, dst_base);
+        print_library_stats("icache");
+    }
+
+    if (table_enabled("fault"))
+    {
+        run_fault_table(bench_sizes, sizeof(bench_sizes) / sizeof(bench_sizes[0]), target_duration_ns,
+                        expected_gbs, src_base, dst_base);
+        print_library_stats("fault");
+    }
+
+    if (table_enabled("handoff"))
+    {
+        run_handoff_table(target_duration_ns, expected_gbs, src_base, dst_base);
+        print_library_stats("handoff");
+    }
+
+    if (table_enabled("async"))
+    {
+        run_async_table(target_duration_ns, src_base, dst_base);
+        print_library_stats("async");
+    }
+
+    if (table_enabled("grid"))
+    {
+        run_engine_grid(bench_sizes, sizeof(bench_sizes) / sizeof(bench_sizes[0]), target_duration_ns,
+                        expected_gbs, src_base, dst_base);
+        print_library_stats("grid");
+    }
+
+    print_summary();
+
 #ifdef SHARED
-    cleanup_functions(&implementations[0]);
-    cleanup_functions(&implementations[1]);
+    cleanup_libs();
 #endif
+    for (size_t i = 0; i < num_implementations; i++)
+    {
+        if (implementations[i].handle)
+            dlclose(implementations[i].handle);
+    }
     __aligned_free(src_base);
     __aligned_free(dst_base);
+    __aligned_free(pool_src);
+    __aligned_free(pool_dst);
 
     return 0;
 }
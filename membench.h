@@ -29,6 +29,7 @@
 #  define memlib "./libmembase32-windows-msvc.dll"
 # else
 #  define memlib "./libmembase64-windows-msvc.dll"
+#  define compactlib "./libmembase64-compact-windows-msvc.dll"
 # endif
 #elif defined(MUSL)
 # define stdlib "libc.so"
@@ -37,14 +38,20 @@
 #  define memlib "./libmembase32-linux-musl.so"
 # else
 #  define memlib "./libmembase64-linux-musl.so"
+#  define compactlib "./libmembase64-compact-linux-musl.so"
 # endif
 #else
 # define stdlib "libc.so.6"
 # define stdlib_fb stdlib
 # ifdef __i386__
 #  define memlib "./libmembase32-linux-gnu.so"
+# elif defined(__aarch64__)
+#  define memlib "./libmembase64-aarch64-linux-gnu.so"
+#  define compactlib "./libmembase64-compact-aarch64-linux-gnu.so"
 # else
 #  define memlib "./libmembase64-linux-gnu.so"
+#  define compactlib "./libmembase64-compact-linux-gnu.so"
+#  define fatlib "./libmembase64-fat-linux-gnu.so"
 # endif
 #endif
 
@@ -80,8 +87,115 @@ static inline void __aligned_free(void *ptr)
     _aligned_free(ptr);
 }
 
+/* committed but never touched, so the first write to each page faults */
+static inline void *map_fresh(size_t size)
+{
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+static inline void unmap_fresh(void *ptr, size_t size)
+{
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+typedef HANDLE bench_thread;
+typedef DWORD_PTR bench_affinity;
+#define AFFINITY_MAX_CPUS ((int)sizeof(DWORD_PTR) * 8)
+
+struct thread_start
+{
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+static DWORD WINAPI thread_trampoline(void *param)
+{
+    struct thread_start start = *(struct thread_start *)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+static inline int start_thread(bench_thread *thread, void (*fn)(void *arg), void *arg)
+{
+    struct thread_start *start = malloc(sizeof(*start));
+    if (!start)
+        return 0;
+    *start = (struct thread_start){fn, arg};
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!*thread)
+        free(start);
+    return *thread != NULL;
+}
+
+static inline void join_thread(bench_thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static inline void yield_thread(void)
+{
+    SwitchToThread();
+}
+
+static inline void get_affinity(bench_affinity *affinity)
+{
+    DWORD_PTR system;
+    GetProcessAffinityMask(GetCurrentProcess(), affinity, &system);
+}
+
+static inline void set_affinity(const bench_affinity *affinity)
+{
+    SetThreadAffinityMask(GetCurrentThread(), *affinity);
+}
+
+static inline int affinity_has(const bench_affinity *affinity, int cpu)
+{
+    return (*affinity >> cpu) & 1;
+}
+
+static inline int pin_thread(int cpu)
+{
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+/* the package and the core that a cpu is one hardware thread of */
+static inline int cpu_topology(int cpu, int *package, int *core)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION info[256];
+    DWORD length = sizeof(info);
+    int found = 0;
+
+    if (!GetLogicalProcessorInformation(info, &length))
+        return 0;
+    for (DWORD i = 0; i < length / sizeof(info[0]); i++)
+    {
+        if (!((info[i].ProcessorMask >> cpu) & 1))
+            continue;
+        /* the lowest cpu of each group names it */
+        const int first = __builtin_ctzll(info[i].ProcessorMask);
+        if (info[i].Relationship == RelationProcessorCore)
+        {
+            *core = first;
+            found |= 1;
+        }
+        else if (info[i].Relationship == RelationProcessorPackage)
+        {
+            *package = first;
+            found |= 2;
+        }
+    }
+    return found == 3;
+}
+
 #else
 #include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
 #include <time.h>
 
 typedef void *dl_handle;
@@ -96,6 +210,106 @@ static inline void __aligned_free(void *ptr)
     free(ptr);
 }
 
+static inline void *map_fresh(size_t size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static inline void unmap_fresh(void *ptr, size_t size)
+{
+    munmap(ptr, size);
+}
+
+typedef pthread_t bench_thread;
+typedef cpu_set_t bench_affinity;
+#define AFFINITY_MAX_CPUS CPU_SETSIZE
+
+struct thread_start
+{
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+static void *thread_trampoline(void *param)
+{
+    struct thread_start start = *(struct thread_start *)param;
+    free(param);
+    start.fn(start.arg);
+    return NULL;
+}
+
+static inline int start_thread(bench_thread *thread, void (*fn)(void *arg), void *arg)
+{
+    struct thread_start *start = malloc(sizeof(*start));
+    if (!start)
+        return 0;
+    *start = (struct thread_start){fn, arg};
+    if (pthread_create(thread, NULL, thread_trampoline, start))
+    {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+static inline void join_thread(bench_thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static inline void yield_thread(void)
+{
+    sched_yield();
+}
+
+static inline void get_affinity(bench_affinity *affinity)
+{
+    CPU_ZERO(affinity);
+    sched_getaffinity(0, sizeof(*affinity), affinity);
+}
+
+static inline void set_affinity(const bench_affinity *affinity)
+{
+    pthread_setaffinity_np(pthread_self(), sizeof(*affinity), affinity);
+}
+
+static inline int affinity_has(const bench_affinity *affinity, int cpu)
+{
+    return CPU_ISSET(cpu, affinity);
+}
+
+static inline int pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static inline int read_topology_id(int cpu, const char *name)
+{
+    char path[128];
+    int id = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (fscanf(f, "%d", &id) != 1)
+        id = -1;
+    fclose(f);
+    return id;
+}
+
+/* the package and the core that a cpu is one hardware thread of */
+static inline int cpu_topology(int cpu, int *package, int *core)
+{
+    *package = read_topology_id(cpu, "physical_package_id");
+    *core = read_topology_id(cpu, "core_id");
+    return *package >= 0 && *core >= 0;
+}
+
 #endif
 
 struct timespec_portable
@@ -104,9 +318,16 @@ struct timespec_portable
     int64_t tv_nsec;
 };
 
+/* no load or store crosses a timestamp */
+#ifdef __aarch64__
+# define timing_fence() __asm__ __volatile__ ( "dsb sy" : : : "memory" )
+#else
+# define timing_fence() __asm__ __volatile__ ( "mfence" : : : "memory" )
+#endif
+
 static inline void get_monotonic_time(struct timespec_portable *ts)
 {
-    __asm__ __volatile__ ( "mfence" : : : "memory" );
+    timing_fence();
 #ifdef _WIN32
     static LARGE_INTEGER freq;
     static int init = 0;
@@ -128,7 +349,7 @@ static inline void get_monotonic_time(struct timespec_portable *ts)
     ts->tv_sec = native_ts.tv_sec;
     ts->tv_nsec = native_ts.tv_nsec;
 #endif
-    __asm__ __volatile__ ( "mfence" : : : "memory" );
+    timing_fence();
 }
 
 static inline double timespec_to_seconds(const struct timespec_portable *start,
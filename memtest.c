@@ -19,6 +19,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -27,8 +28,42 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "membase.h"
+
 void *memcpy_local(void *dst, const void *src, size_t n);
 void *memmove_local(void *dst, const void *src, size_t n);
+const struct memop_engine *memop_engines(size_t *count);
+int memop_avx512_policy(int policy);
+void *memcpy_bswap16(void *dst, const void *src, size_t n);
+void *memcpy_bswap32(void *dst, const void *src, size_t n);
+void *memcpy_bswap64(void *dst, const void *src, size_t n);
+void *memchr_local(const void *s, int c, size_t n);
+void *memrchr_local(const void *s, int c, size_t n);
+size_t strlen_local(const char *s);
+size_t strnlen_local(const char *s, size_t maxlen);
+void *memcpy_pad(void *dst, const void *src, size_t n, size_t total, int fill);
+char *stpcpy_local(char *dst, const char *src);
+char *stpncpy_local(char *dst, const char *src, size_t n);
+size_t strlcpy_local(char *dst, const char *src, size_t size);
+void *memcpy_persist(void *dst, const void *src, size_t n);
+size_t memcpy_delta(void *dst, const void *src, size_t n, uint64_t *dirty_lines);
+size_t memcpy_sparse(void *dst, const void *src, size_t n, uint64_t *zero_pages);
+void memswap_local(void *a, void *b, size_t n);
+void *memrotate_local(void *buf, size_t n, size_t shift);
+void *memcpy_profiled(void *dst, const void *src, size_t n);
+void *memcpy_gather(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size);
+void *memcpy_scatter(void *dst, const void *src, const uint32_t *idx, size_t count, size_t size);
+void *memcpy_hint(void *dst, const void *src, size_t n, int flags);
+void *memcpy_prefault(void *dst, const void *src, size_t n);
+memcpy_handle memcpy_async(void *dst, const void *src, size_t n);
+void memcpy_wait(memcpy_handle handle);
+int memcpy_test(memcpy_handle handle);
+void memcpy_async_shutdown(void);
+int membase_stats_snapshot(struct membase_stats *stats);
+size_t membase_cache_size(int level);
+void *memcpy2d(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height);
+void *memcpy3d(void *dst, size_t dpitch, size_t dslice, const void *src, size_t spitch, size_t sslice,
+               size_t width, size_t height, size_t depth);
 
 static int failed_tests = 0;
 static int total_tests = 0;
@@ -347,28 +382,1614 @@ static void test_memmove_overlaps(stringop_fn fn)
     }
 }
 
-int main(int argc, char *argv[])
+static void test_memmove_split(stringop_fn fn)
 {
-    unsigned int failed_temp = 0;
-    page_size = sysconf(_SC_PAGESIZE);
+    printf("\ntesting memmove large backward overlaps...\n");
 
-    const char *test_type = (argc > 1) ? argv[1] : "all";
+    /* the last one past STREAMING_THRESHOLD, where the chunks go out with non-temporal stores */
+    const ssize_t sizes[] = {8 * 1024, 64 * 1024, 1024 * 1024 + 77, (ssize_t)membase_cache_size(0) + 77};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        ssize_t size = sizes[i];
+        /* the membench overlap cases, plus distances that don't divide the size */
+        ssize_t offsets[] = {size * 3 / 4, size / 2, size / 4, size - 1, size / 3, size / 7 + 5, 8 * 1024, 8 * 1024 - 1};
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); j++)
+        {
+            if (offsets[j] > 0 && offsets[j] < size)
+                run_overlap_test("memmove", offsets[j], size, fn);
+        }
+    }
+}
 
-    if (strcmp(test_type, "memcpy") == 0 || strcmp(test_type, "all") == 0)
+static memop_fn current_engine;
+
+static void *engine_forward(void *dst, const void *src, size_t n)
+{
+    return current_engine(dst, src, n, 0);
+}
+
+static void *engine_backward(void *dst, const void *src, size_t n)
+{
+    return current_engine(dst, src, n, 1);
+}
+
+static void test_engines(void)
+{
+    size_t count;
+    const struct memop_engine *engines = memop_engines(&count);
+
+    printf("\ntesting %zu generated engines...\n", count);
+
+    /* each tier flags exactly one of its engines as the one the dispatchers use */
+    for (size_t i = 0; i < count; i++)
     {
-        test_operation("memcpy", memcpy_local);
-        failed_temp = failed_tests;
-        if (!failed_temp)
-            printf("\nall memcpy tests passed.\n");
+        size_t flagged = 0;
+        for (size_t j = 0; j < count; j++)
+            flagged += engines[j].feature == engines[i].feature && engines[j].dispatch;
+        if (flagged != 1)
+        {
+            printf("fail [%s]: %zu engines of its tier flagged as the dispatchers'\n", engines[i].name, flagged);
+            failed_tests++;
+            break;
+        }
     }
+    total_tests++;
 
-    if (strcmp(test_type, "memmove") == 0 || strcmp(test_type, "all") == 0)
+    /* every unroll group size up to 16 AVX-512 vectors, and either side of it */
+    const size_t lens[] = {1, 15, 31, 63, 64, 65, 127, 129, 255, 257, 511, 513, 1023, 1025, 2047, 2049, 4096 + 77};
+    for (size_t i = 0; i < count; i++)
     {
-        test_operation("memmove", memmove_local);
-        test_memmove_overlaps(memmove_local);
-        failed_temp = failed_tests - failed_temp;
-        if (!failed_temp)
-            printf("\nall memmove tests passed.\n");
+        if (!cpu_supports(engines[i].feature))
+            continue;
+        current_engine = engines[i].fn;
+
+        for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); j++)
+        {
+            run_alignment_test(engines[i].name, engine_forward, 0, 0, lens[j]);
+            run_alignment_test(engines[i].name, engine_forward, 3, 9, lens[j]);
+            run_alignment_test(engines[i].name, engine_backward, 5, 0, lens[j]);
+
+            /* each direction is a valid memmove for its own kind of overlap */
+            run_overlap_test(engines[i].name, -(ssize_t)(lens[j] / 3 + 1), lens[j], engine_forward);
+            run_overlap_test(engines[i].name, lens[j] / 3 + 1, lens[j], engine_backward);
+        }
+    }
+}
+
+/* 2D when depth is 0, otherwise 3D; everything in dst outside the copied rows,
+ * including the gaps between rows and slices, must keep its guard pattern */
+static void run_copy3d_test(size_t width, size_t height, size_t depth, size_t spitch, size_t dpitch,
+                            size_t sslice, size_t dslice)
+{
+    const size_t guard_size = 64;
+    const size_t slices = depth ? depth : 1;
+    const size_t src_size = sslice * (slices - 1) + spitch * (height - 1) + width;
+    const size_t dst_size = guard_size + dslice * (slices - 1) + dpitch * (height - 1) + width + guard_size;
+
+    unsigned char *src = malloc(src_size);
+    unsigned char *dst_base = malloc(dst_size);
+    unsigned char *expected_base = malloc(dst_size);
+
+    if (!src || !dst_base || !expected_base)
+    {
+        fprintf(stderr, "memory allocation failed\n");
+        exit(1);
+    }
+
+#pragma clang optimize off
+    for (size_t i = 0; i < src_size; i++)
+    {
+        src[i] = (unsigned char)((i * 5 + 3) & 0xFF);
+    }
+#pragma clang optimize on
+
+    memset(dst_base, 0xA5, dst_size);
+    memset(expected_base, 0xA5, dst_size);
+
+    unsigned char *dst = dst_base + guard_size;
+    unsigned char *expected = expected_base + guard_size;
+
+    for (size_t z = 0; z < slices; z++)
+        for (size_t y = 0; y < height; y++)
+            memcpy(expected + z * dslice + y * dpitch, src + z * sslice + y * spitch, width);
+
+    void *result = depth ? memcpy3d(dst, dpitch, dslice, src, spitch, sslice, width, height, depth)
+                         : memcpy2d(dst, dpitch, src, spitch, width, height);
+    const char *op = depth ? "memcpy3d" : "memcpy2d";
+
+    if (result != dst)
+    {
+        test_failed(op, "wrong return value", spitch, dpitch, width, expected, dst);
+    }
+
+    for (size_t i = 0; i < dst_size; i++)
+    {
+        if (dst_base[i] != expected_base[i])
+        {
+            ssize_t offset = (ssize_t)i - (ssize_t)guard_size;
+            size_t span = depth ? dslice : dpitch * height;
+            size_t in_slice = offset >= 0 ? (size_t)offset % span : 0;
+            int in_row = offset >= 0 && in_slice < dpitch * height && in_slice % dpitch < width &&
+                         (size_t)offset / span < slices;
+            printf("(height=%zu, depth=%zu, byte %zd)\n", height, depth, offset);
+            test_failed(op, in_row ? "row content mismatch" : "guard between rows corrupted",
+                        spitch, dpitch, width, expected_base + i, dst_base + i);
+            break;
+        }
+    }
+
+    free(src);
+    free(dst_base);
+    free(expected_base);
+    total_tests++;
+}
+
+static void test_copy2d(void)
+{
+    printf("\ntesting memcpy2d/memcpy3d...\n");
+
+    /* the fixed width kernels, the overlapping ranges between them, and the engines */
+    const size_t widths[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 200, 1000, 4096 + 5};
+    const size_t heights[] = {1, 2, 7, 33};
+    const size_t pads[] = {0, 1, 13, 64};
+
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(heights) / sizeof(heights[0]); j++)
+        {
+            for (size_t k = 0; k < sizeof(pads) / sizeof(pads[0]); k++)
+            {
+                size_t w = widths[i], h = heights[j];
+                run_copy3d_test(w, h, 0, w + pads[k], w + pads[(k + 1) % 4], 0, 0);
+                run_copy3d_test(w, h, 0, w + pads[k], w, 0, 0);
+            }
+
+            /* gapped slices, and contiguous ones that collapse into more rows */
+            size_t w = widths[i], h = heights[j];
+            run_copy3d_test(w, h, 3, w + 3, w + 7, (w + 3) * h + 11, (w + 7) * h + 5);
+            run_copy3d_test(w, h, 3, w + 3, w + 7, (w + 3) * h, (w + 7) * h);
+            run_copy3d_test(w, h, 2, w, w, w * h, w * h);
+        }
+    }
+}
+
+/* in place when align2 is SIZE_MAX */
+static void run_bswap_test(const char *op, stringop_fn fn, size_t elem_size, size_t align1, size_t align2, size_t len)
+{
+    const size_t guard_size = 64;
+    unsigned char *src_base = malloc(guard_size + 64 + len + guard_size);
+    unsigned char *dst_base = malloc(guard_size + 64 + len + guard_size);
+    unsigned char *expected = malloc(len + 1);
+
+    if (!src_base || !dst_base || !expected)
+    {
+        fprintf(stderr, "memory allocation failed\n");
+        exit(1);
+    }
+
+    const int in_place = align2 == SIZE_MAX;
+    unsigned char *src = src_base + guard_size + align1;
+    unsigned char *dst = in_place ? src : dst_base + guard_size + align2;
+
+    memset(src_base, 0xA5, guard_size + 64 + len + guard_size);
+    memset(dst_base, 0xA5, guard_size + 64 + len + guard_size);
+
+#pragma clang optimize off
+    for (size_t i = 0; i < len; i++)
+    {
+        src[i] = (unsigned char)((i * 7 + 13) & 0xFF);
+    }
+#pragma clang optimize on
+
+    /* whole elements reversed, a partial one at the end left alone */
+    for (size_t i = 0; i < len; i++)
+    {
+        size_t elem_start = i / elem_size * elem_size;
+        expected[i] = elem_start + elem_size <= len ? src[elem_start + elem_size - 1 - i % elem_size] : src[i];
+    }
+
+    void *result = fn(dst, src, len);
+
+    if (result != dst)
+    {
+        test_failed(op, "wrong return value", align1, align2, len, expected, dst);
+    }
+
+    if (memcmp(expected, dst, len) != 0)
+    {
+        test_failed(op, in_place ? "content mismatch in place" : "content mismatch", align1, align2, len, expected, dst);
+    }
+
+    for (size_t i = 0; i < guard_size; i++)
+    {
+        if (dst[-(ssize_t)guard_size + (ssize_t)i] != 0xA5 || dst[len + i] != 0xA5)
+        {
+            test_failed(op, "guard corrupted", align1, align2, len, expected, dst);
+            break;
+        }
+    }
+
+    free(src_base);
+    free(dst_base);
+    free(expected);
+    total_tests++;
+}
+
+static void test_bswap(void)
+{
+    static const struct
+    {
+        const char *name;
+        stringop_fn fn;
+        size_t elem_size;
+    } ops[] = {{"memcpy_bswap16", memcpy_bswap16, 2}, {"memcpy_bswap32", memcpy_bswap32, 4}, {"memcpy_bswap64", memcpy_bswap64, 8}};
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        printf("\ntesting %s...\n", ops[i].name);
+
+        for (size_t len = 0; len <= 300; len++)
+        {
+            run_bswap_test(ops[i].name, ops[i].fn, ops[i].elem_size, 0, 0, len);
+            run_bswap_test(ops[i].name, ops[i].fn, ops[i].elem_size, 1, 3, len);
+            run_bswap_test(ops[i].name, ops[i].fn, ops[i].elem_size, 5, SIZE_MAX, len);
+        }
+
+        size_t large[] = {4096, 4096 + 6, 65536 + 13};
+        for (size_t j = 0; j < sizeof(large) / sizeof(large[0]); j++)
+        {
+            run_bswap_test(ops[i].name, ops[i].fn, ops[i].elem_size, 7, 2, large[j]);
+            run_bswap_test(ops[i].name, ops[i].fn, ops[i].elem_size, 0, SIZE_MAX, large[j]);
+        }
+    }
+}
+
+static void scan_failed(const char *op, const char *msg, size_t offset, size_t len, ssize_t expected, ssize_t actual)
+{
+    printf("fail [%s]: %s (offset=%zu, len=%zu, expected %zd, got %zd)\n", op, msg, offset, len, expected, actual);
+    failed_tests++;
+}
+
+/* one read/write page between two inaccessible ones, so that any over-read
+ * past either end of it faults */
+static unsigned char *map_guarded_page(void)
+{
+    unsigned char *base = mmap(NULL, 3 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "failed to allocate guarded page\n");
+        exit(1);
+    }
+    mprotect(base, page_size, PROT_NONE);
+    mprotect(base + 2 * page_size, page_size, PROT_NONE);
+    return base + page_size;
+}
+
+static void test_scan(void)
+{
+    unsigned char *page = map_guarded_page();
+
+    printf("\ntesting strlen/strnlen at the end of a page...\n");
+    memset(page, 'a', page_size);
+    for (size_t len = 0; len < 600; len++)
+    {
+        /* the terminator is the very last readable byte */
+        char *str = (char *)page + page_size - 1 - len;
+        str[len] = '\0';
+
+        size_t got = strlen_local(str);
+        if (got != len)
+            scan_failed("strlen", "wrong length", page_size - 1 - len, len, len, got);
+
+        size_t maxlens[] = {0, len / 2, len, len + 1, SIZE_MAX};
+        for (size_t i = 0; i < sizeof(maxlens) / sizeof(maxlens[0]); i++)
+        {
+            size_t expected = maxlens[i] < len ? maxlens[i] : len;
+            got = strnlen_local(str, maxlens[i]);
+            if (got != expected)
+                scan_failed("strnlen", "wrong length", page_size - 1 - len, maxlens[i], expected, got);
+            total_tests++;
+        }
+
+        str[len] = 'a';
+        total_tests++;
+    }
+
+    /* a string ending mid-page with more string-looking bytes up to the guard */
+    for (size_t offset = 0; offset < 256; offset++)
+    {
+        char *str = (char *)page + page_size - 256 + offset;
+        size_t len = (256 - offset) / 2;
+        str[len] = '\0';
+        if (strlen_local(str) != len || strnlen_local(str, SIZE_MAX) != len)
+            scan_failed("strlen", "wrong length mid-page", offset, len, len, strlen_local(str));
+        str[len] = 'a';
+        total_tests++;
+    }
+
+    printf("\ntesting memchr/memrchr at both ends of a page...\n");
+    memset(page, 'a', page_size);
+    for (size_t len = 0; len < 300; len++)
+    {
+        /* memchr from len bytes before the end of the page, memrchr from its start */
+        unsigned char *fwd = page + page_size - len;
+        unsigned char *bwd = page;
+
+        for (size_t pos = 0; pos <= len; pos++)
+        {
+            /* pos == len means no match */
+            if (pos < len)
+            {
+                fwd[pos] = 'X';
+                bwd[pos] = 'X';
+            }
+
+            void *expected_fwd = pos < len ? fwd + pos : NULL;
+            void *expected_bwd = pos < len ? bwd + pos : NULL;
+            void *got = memchr_local(fwd, 'X', len);
+            if (got != expected_fwd)
+                scan_failed("memchr", "wrong match", pos, len, expected_fwd ? (ssize_t)pos : -1,
+                            got ? (unsigned char *)got - fwd : -1);
+
+            got = memrchr_local(bwd, 'X', len);
+            if (got != expected_bwd)
+                scan_failed("memrchr", "wrong match", pos, len, expected_bwd ? (ssize_t)pos : -1,
+                            got ? (unsigned char *)got - bwd : -1);
+
+            /* a second match before it is found by memchr only after pos, by memrchr only before */
+            if (pos > 1 && pos < len)
+            {
+                fwd[pos / 2] = 'X';
+                bwd[pos / 2] = 'X';
+                if (memchr_local(fwd, 'X', len) != fwd + pos / 2)
+                    scan_failed("memchr", "wrong first match", pos / 2, len, pos / 2, -1);
+                if (memrchr_local(bwd, 'X', len) != bwd + pos)
+                    scan_failed("memrchr", "wrong last match", pos, len, pos, -1);
+                fwd[pos / 2] = 'a';
+                bwd[pos / 2] = 'a';
+            }
+
+            if (pos < len)
+            {
+                fwd[pos] = 'a';
+                bwd[pos] = 'a';
+            }
+            total_tests += 2;
+        }
+    }
+
+    /* n may run past the buffer as long as c comes first (C11 7.24.5.1) */
+    for (size_t pos = 0; pos < 300; pos++)
+    {
+        unsigned char *buf = page + page_size - 1 - pos;
+        buf[pos] = 'X';
+        if (memchr_local(buf, 'X', SIZE_MAX / 2) != buf + pos)
+            scan_failed("memchr", "wrong match with oversized n", pos, SIZE_MAX / 2, pos, -1);
+        buf[pos] = 'a';
+        total_tests++;
+    }
+
+    munmap(page - page_size, 3 * page_size);
+}
+
+static void run_pad_test(size_t align1, size_t align2, size_t n, size_t total)
+{
+    const size_t guard = 64;
+    const size_t record = total > n ? total : n;
+    unsigned char *src = malloc(record + 128);
+    unsigned char *dst = malloc(record + 2 * guard + 128);
+    unsigned char *expected = malloc(record + 2 * guard + 128);
+
+    for (size_t i = 0; i < record + 128; i++)
+        src[i] = (unsigned char)(i * 7 + 1);
+    memset(dst, 0xee, record + 2 * guard + 128);
+    memcpy(expected, dst, record + 2 * guard + 128);
+
+    unsigned char *d = dst + guard + align1;
+    unsigned char *e = expected + guard + align1;
+    const size_t copied = n < total ? n : total;
+    memcpy(e, src + align2, copied);
+    memset(e + copied, 0x5a, total - copied);
+
+    void *ret = memcpy_pad(d, src + align2, n, total, 0x5a);
+    if (ret != d)
+        test_failed("memcpy_pad", "wrong return value", align1, align2, total, e, d);
+    else if (memcmp(dst, expected, record + 2 * guard + 128))
+    {
+        size_t i = 0;
+        while (dst[i] == expected[i])
+            i++;
+        printf("(n=%zu, total=%zu, first difference at %zd)\n", n, total, (ssize_t)i - (ssize_t)(guard + align1));
+        test_failed("memcpy_pad", "wrong record or guard bytes", align1, align2, total, e, d);
+    }
+
+    free(src);
+    free(dst);
+    free(expected);
+    total_tests++;
+}
+
+static void test_pad(void)
+{
+    printf("\ntesting memcpy_pad...\n");
+    for (size_t total = 0; total < 300; total++)
+    {
+        for (size_t n = 0; n <= total + 1; n++)
+        {
+            run_pad_test(0, 0, n, total);
+            run_pad_test(3, 1, n, total);
+        }
+    }
+
+    const size_t large[] = {4096, 65536 + 13, 1024 * 1024 + 1};
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++)
+    {
+        run_pad_test(5, 9, large[i] / 3, large[i]);
+        run_pad_test(0, 0, large[i] - 1, large[i]);
+        run_pad_test(1, 0, 0, large[i]);
+    }
+}
+
+/* copies of a string ending at the last readable byte of a page, and of unterminated
+ * bytes running up to it for the bounded copies that must stop before the guard */
+static void test_strcopy(void)
+{
+    unsigned char *page = map_guarded_page();
+    const size_t guard = 32;
+    char *buf = malloc(page_size + 2 * guard);
+    char *expected = malloc(page_size + 2 * guard);
+
+    printf("\ntesting stpcpy/stpncpy/strlcpy at the end of a page...\n");
+    for (size_t i = 0; i < page_size; i++)
+        page[i] = 'a' + i % 26;
+
+    for (size_t len = 0; len < 600; len++)
+    {
+        char *str = (char *)page + page_size - 1 - len;
+        char *dst = buf + guard + len % 7;
+        str[len] = '\0';
+
+        memset(buf, 0xee, page_size + 2 * guard);
+        char *end = stpcpy_local(dst, str);
+        if (end != dst + len || memcmp(dst, str, len + 1) || (unsigned char)dst[len + 1] != 0xee ||
+            (unsigned char)dst[-1] != 0xee)
+            scan_failed("stpcpy", "wrong copy", page_size - 1 - len, len, len, end - dst);
+        total_tests++;
+
+        size_t bounds[] = {0, 1, len / 2, len, len + 1, len + 100};
+        for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++)
+        {
+            const size_t n = bounds[i];
+            const size_t copied = n < len ? n : len;
+
+            memset(buf, 0xee, page_size + 2 * guard);
+            memcpy(expected, buf, page_size + 2 * guard);
+            memcpy(expected + (dst - buf), str, copied);
+            memset(expected + (dst - buf) + copied, 0, n - copied);
+            end = stpncpy_local(dst, str, n);
+            if (end != dst + copied || memcmp(buf, expected, page_size + 2 * guard))
+                scan_failed("stpncpy", "wrong copy", len, n, copied, end - dst);
+
+            memset(buf, 0xee, page_size + 2 * guard);
+            memcpy(expected, buf, page_size + 2 * guard);
+            if (n)
+            {
+                const size_t kept = len < n - 1 ? len : n - 1;
+                memcpy(expected + (dst - buf), str, kept);
+                expected[dst - buf + kept] = '\0';
+            }
+            size_t got = strlcpy_local(dst, str, n);
+            if (got != len || memcmp(buf, expected, page_size + 2 * guard))
+                scan_failed("strlcpy", "wrong copy", len, n, len, got);
+            total_tests += 2;
+        }
+
+        str[len] = 'a' + (page_size - 1) % 26;
+    }
+
+    /* no terminator at all before the guard, so only the bound stops the read */
+    for (size_t len = 1; len < 300; len++)
+    {
+        char *str = (char *)page + page_size - len;
+        char *dst = buf + guard;
+        memset(buf, 0xee, page_size + 2 * guard);
+        char *end = stpncpy_local(dst, str, len);
+        if (end != dst + len || memcmp(dst, str, len) || (unsigned char)dst[len] != 0xee)
+            scan_failed("stpncpy", "wrong unterminated copy", page_size - len, len, len, end - dst);
+        total_tests++;
+    }
+
+    free(buf);
+    free(expected);
+    munmap(page - page_size, 3 * page_size);
+}
+
+/* dst at every offset into a line, so that each mix of partial and whole lines comes up */
+static void run_persist_test(size_t line_offset, size_t src_offset, size_t len)
+{
+    const size_t guard = 128;
+    unsigned char *src = malloc(len + 64);
+    unsigned char *dst_base = malloc(len + 2 * guard + 64);
+
+    for (size_t i = 0; i < len + 64; i++)
+        src[i] = (unsigned char)(i * 13 + 5);
+    memset(dst_base, 0xee, len + 2 * guard + 64);
+
+    unsigned char *dst = (unsigned char *)(((uintptr_t)dst_base + guard + 63) & ~(uintptr_t)63) + line_offset;
+    void *ret = memcpy_persist(dst, src + src_offset, len);
+
+    if (ret != dst)
+        test_failed("memcpy_persist", "wrong return value", line_offset, src_offset, len, src + src_offset, dst);
+    else if (memcmp(dst, src + src_offset, len))
+        test_failed("memcpy_persist", "content mismatch", line_offset, src_offset, len, src + src_offset, dst);
+    else
+    {
+        for (unsigned char *p = dst_base; p < dst_base + len + 2 * guard + 64; p++)
+        {
+            if ((p < dst || p >= dst + len) && *p != 0xee)
+            {
+                test_failed("memcpy_persist", "guard corrupted", line_offset, src_offset, len, src + src_offset,
+                            dst);
+                break;
+            }
+        }
+    }
+
+    free(src);
+    free(dst_base);
+    total_tests++;
+}
+
+static void test_persist(void)
+{
+    printf("\ntesting memcpy_persist...\n");
+    for (size_t len = 0; len <= 300; len++)
+    {
+        for (size_t line_offset = 0; line_offset < 64; line_offset++)
+            run_persist_test(line_offset, line_offset % 5, len);
+    }
+
+    const size_t large[] = {4096, 4096 + 63, 65536 + 1, 1024 * 1024};
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++)
+    {
+        run_persist_test(0, 0, large[i]);
+        run_persist_test(1, 3, large[i]);
+        run_persist_test(63, 0, large[i]);
+    }
+}
+
+/* dst a copy of src with every stride-th byte changed, at every offset into a line */
+static void run_delta_test(size_t line_offset, size_t src_offset, size_t len, size_t stride)
+{
+    const size_t guard = 128;
+    unsigned char *src = malloc(len + 64);
+    unsigned char *dst_base = malloc(len + 2 * guard + 64);
+    unsigned char *dst = (unsigned char *)(((uintptr_t)dst_base + guard + 63) & ~(uintptr_t)63) + line_offset;
+    const size_t words = (MEMCPY_DELTA_LINES(line_offset, len) + 63) / 64;
+    uint64_t *bitmap = malloc((words + 1) * sizeof(uint64_t));
+    uint64_t *expected_bitmap = calloc(words + 1, sizeof(uint64_t));
+    size_t expected = 0;
+
+    for (size_t i = 0; i < len + 64; i++)
+        src[i] = (unsigned char)(i * 13 + 5);
+    for (size_t i = 0; i <= words; i++)
+        bitmap[i] = 0x5555555555555555ULL;
+    memset(dst_base, 0xee, len + 2 * guard + 64);
+    memcpy(dst, src + src_offset, len);
+    for (size_t i = stride - 1; i < len; i += stride, expected++)
+    {
+        const size_t line = (line_offset + i) / 64;
+        dst[i] ^= 0x5a;
+        expected_bitmap[line / 64] |= 1ULL << (line % 64);
+    }
+
+    /* every other call without the bitmap */
+    const int with_bitmap = (len + line_offset) % 2;
+    const size_t changed = memcpy_delta(dst, src + src_offset, len, with_bitmap ? bitmap : NULL);
+
+    if (changed != expected)
+        test_failed("memcpy_delta", "wrong changed byte count", line_offset, src_offset, len, src + src_offset, dst);
+    else if (with_bitmap && (memcmp(bitmap, expected_bitmap, words * sizeof(uint64_t)) ||
+                             bitmap[words] != 0x5555555555555555ULL))
+        test_failed("memcpy_delta", "wrong stored line bitmap", line_offset, src_offset, len, src + src_offset, dst);
+    else if (memcmp(dst, src + src_offset, len))
+        test_failed("memcpy_delta", "content mismatch", line_offset, src_offset, len, src + src_offset, dst);
+    else
+    {
+        for (unsigned char *p = dst_base; p < dst_base + len + 2 * guard + 64; p++)
+        {
+            if ((p < dst || p >= dst + len) && *p != 0xee)
+            {
+                test_failed("memcpy_delta", "guard corrupted", line_offset, src_offset, len, src + src_offset, dst);
+                break;
+            }
+        }
+    }
+
+    free(src);
+    free(dst_base);
+    free(bitmap);
+    free(expected_bitmap);
+    total_tests++;
+}
+
+/* unchanged lines must not be stored at all, so a read-only page holding only those is fine */
+static void test_delta_readonly(void)
+{
+    unsigned char *src = malloc(3 * page_size);
+    unsigned char *dst = mmap(NULL, 3 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (dst == MAP_FAILED)
+    {
+        free(src);
+        return;
+    }
+
+    for (size_t i = 0; i < 3 * page_size; i++)
+        src[i] = (unsigned char)(i * 7 + 1);
+    memcpy(dst, src, 3 * page_size);
+    src[page_size + 100] ^= 1;
+    src[page_size + page_size / 2] ^= 1;
+    mprotect(dst, page_size, PROT_READ);
+    mprotect(dst + 2 * page_size, page_size, PROT_READ);
+
+    if (memcpy_delta(dst + 3, src + 3, 3 * page_size - 6, NULL) != 2 || memcmp(dst, src, 3 * page_size))
+        test_failed("memcpy_delta", "changes within one writable page", 3, 3, 3 * page_size - 6, src, dst);
+
+    munmap(dst, 3 * page_size);
+    free(src);
+    total_tests++;
+}
+
+static void test_delta(void)
+{
+    static const size_t strides[] = {1, 7, 64, 100, SIZE_MAX};
+
+    printf("\ntesting memcpy_delta...\n");
+    for (size_t len = 0; len <= 300; len++)
+    {
+        for (size_t line_offset = 0; line_offset < 64; line_offset++)
+            run_delta_test(line_offset, line_offset % 5, len, strides[(len + line_offset) % 5]);
+    }
+
+    const size_t large[] = {4096, 4096 + 63, 65536 + 1, 1024 * 1024};
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(strides) / sizeof(strides[0]); j++)
+        {
+            run_delta_test(0, 0, large[i], strides[j]);
+            run_delta_test(17, 3, large[i], strides[j]);
+        }
+    }
+    test_delta_readonly();
+}
+
+/* destination page i zero in src if bit i % 64 of pattern is set, and otherwise holding one
+ * non-zero byte at its start, middle or end */
+static void run_sparse_test(size_t dst_offset, size_t src_offset, size_t len, uint64_t pattern, int with_bitmap)
+{
+    const size_t pages = MEMCPY_SPARSE_PAGES(dst_offset, len);
+    const size_t words = (pages + 63) / 64;
+    const size_t span = (len + 3 * page_size) / page_size * page_size;
+    unsigned char *src_base = aligned_alloc(page_size, span);
+    unsigned char *dst_base = aligned_alloc(page_size, span);
+    unsigned char *ref = malloc(len + 1);
+    uint64_t *bitmap = malloc((words + 1) * sizeof(uint64_t));
+    uint64_t *expected = calloc(words + 1, sizeof(uint64_t));
+    unsigned char *src = src_base + src_offset;
+    unsigned char *dst = dst_base + page_size + dst_offset;
+    size_t zero = 0;
+
+    memset(src_base, 0, span);
+    memset(dst_base, 0xee, span);
+    for (size_t i = 0; i <= words; i++)
+        bitmap[i] = 0x5555555555555555ULL;
+
+    for (size_t page = 0, pos = 0; pos < len; page++)
+    {
+        size_t chunk = MEMCPY_SPARSE_PAGE_SIZE - (dst_offset + pos) % MEMCPY_SPARSE_PAGE_SIZE;
+        chunk = chunk < len - pos ? chunk : len - pos;
+        if (pattern >> (page % 64) & 1)
+        {
+            expected[page / 64] |= 1ULL << (page % 64);
+            zero++;
+        }
+        else
+            src[pos + (page % 3 == 0 ? 0 : page % 3 == 1 ? chunk / 2 : chunk - 1)] = (unsigned char)(page | 1);
+        pos += chunk;
+    }
+    memcpy_local(ref, src, len);
+
+    const size_t ret = memcpy_sparse(dst, src, len, with_bitmap ? bitmap : NULL);
+
+    if (ret != zero)
+        test_failed("memcpy_sparse", "wrong zero page count", dst_offset, src_offset, len, src, dst);
+    else if (with_bitmap && (memcmp(bitmap, expected, words * sizeof(uint64_t)) ||
+                             bitmap[words] != 0x5555555555555555ULL))
+        test_failed("memcpy_sparse", "wrong zero page bitmap", dst_offset, src_offset, len, src, dst);
+    else
+    {
+        /* zero pages untouched, the rest copied; clearing the former has to give memcpy's result */
+        int ok = 1;
+        for (size_t page = 0, pos = 0; pos < len && ok; page++)
+        {
+            size_t chunk = MEMCPY_SPARSE_PAGE_SIZE - (dst_offset + pos) % MEMCPY_SPARSE_PAGE_SIZE;
+            chunk = chunk < len - pos ? chunk : len - pos;
+            for (size_t i = pos; i < pos + chunk && ok; i++)
+                ok = pattern >> (page % 64) & 1 ? dst[i] == 0xee : dst[i] == src[i];
+            if (pattern >> (page % 64) & 1)
+                memset(dst + pos, 0, chunk);
+            pos += chunk;
+        }
+        for (unsigned char *p = dst_base; p < dst_base + span && ok; p++)
+            ok = (p >= dst && p < dst + len) || *p == 0xee;
+
+        if (!ok)
+            test_failed("memcpy_sparse", "zero page written, page missed or guard corrupted", dst_offset, src_offset,
+                        len, src, dst);
+        else if (memcmp(dst, ref, len))
+            test_failed("memcpy_sparse", "mismatch with memcpy_local", dst_offset, src_offset, len, src, dst);
+    }
+
+    free(src_base);
+    free(dst_base);
+    free(ref);
+    free(bitmap);
+    free(expected);
+    total_tests++;
+}
+
+static void test_sparse(void)
+{
+    static const uint64_t patterns[] = {0, ~0ULL, 0xaaaaaaaaaaaaaaaaULL, 0x5bd1e995f00dcafeULL, 0x8000000000000001ULL};
+    const size_t lens[] = {0, 1, 63, 100, 4095, 4096, 4097, 3 * 4096 + 5, 16 * 4096, 70 * 4096 + 777, 200 * 4096};
+    const size_t offsets[] = {0, 1, 64, 4095};
+
+    printf("\ntesting memcpy_sparse...\n");
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); j++)
+        {
+            for (size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); k++)
+                run_sparse_test(offsets[j], (j * 7 + k) % 64, lens[i], patterns[k], 1);
+        }
+        run_sparse_test(17, 3, lens[i], patterns[3], 0);
+    }
+}
+
+/* src and dst at the given offsets from 64 byte alignment, between guards */
+static void run_profiled_test(size_t align1, size_t align2, size_t len)
+{
+    const size_t span = (len + 3 * 64 + 63) & ~(size_t)63;
+    unsigned char *src_base = aligned_alloc(64, span);
+    unsigned char *dst_base = aligned_alloc(64, span);
+    unsigned char *src = src_base + 64 + align1;
+    unsigned char *dst = dst_base + 64 + align2;
+
+    for (size_t i = 0; i < span; i++)
+        src_base[i] = (unsigned char)(i * 7 + 13);
+    memset(dst_base, 0xee, span);
+
+    if (memcpy_profiled(dst, src, len) != dst)
+        test_failed("memcpy_profiled", "wrong return value", align1, align2, len, src, dst);
+    else if (memcmp(dst, src, len))
+        test_failed("memcpy_profiled", "content mismatch", align1, align2, len, src, dst);
+    else
+    {
+        for (unsigned char *p = dst_base; p < dst_base + span; p++)
+        {
+            if ((p < dst || p >= dst + len) && *p != 0xee)
+            {
+                test_failed("memcpy_profiled", "guard corrupted", align1, align2, len, src, dst);
+                break;
+            }
+        }
+    }
+
+    free(src_base);
+    free(dst_base);
+    total_tests++;
+}
+
+/* every size a profile can have (up to make's PROFILE_MAX_SIZE), at alignments that take a
+ * profiled pair's straight line copy and ones that fall through past it */
+static void test_profiled(void)
+{
+    static const size_t alignments[][2] = {{0, 0}, {8, 8}, {16, 48}, {4, 8}, {1, 3}, {63, 0}};
+
+    printf("\ntesting memcpy_profiled...\n");
+    for (size_t len = 0; len <= 1024; len++)
+    {
+        for (size_t i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++)
+            run_profiled_test(alignments[i][0], alignments[i][1], len);
+    }
+    run_profiled_test(0, 0, 65536 + 64);
+    run_profiled_test(5, 9, 1024 * 1024);
+}
+
+/* a and b in one buffer between guards, either right next to each other (as a block swap
+ * rotation has them) or gap bytes apart */
+static void run_swap_test(size_t align1, size_t align2, size_t len, size_t gap)
+{
+    const size_t guard = 64;
+    const size_t span = 2 * len + gap + align1 + align2 + 2 * guard;
+    unsigned char *base = malloc(span);
+    unsigned char *ref = malloc(2 * len + 1);
+    unsigned char *a = base + guard + align1;
+    unsigned char *b = a + len + gap + (gap ? align2 : 0);
+
+    memset(base, 0xee, span);
+    for (size_t i = 0; i < len; i++)
+    {
+        a[i] = (unsigned char)(i * 7 + 1);
+        b[i] = (unsigned char)(i * 13 + 0x80);
+    }
+    memcpy(ref, b, len);
+    memcpy(ref + len, a, len);
+
+    memswap_local(a, b, len);
+
+    if (memcmp(a, ref, len))
+        test_failed("memswap", "a mismatch", align1, align2, len, ref, a);
+    else if (memcmp(b, ref + len, len))
+        test_failed("memswap", "b mismatch", align1, align2, len, ref + len, b);
+    else
+    {
+        for (unsigned char *p = base; p < base + span; p++)
+        {
+            if ((p < a || p >= a + len) && (p < b || p >= b + len) && *p != 0xee)
+            {
+                test_failed("memswap", "guard corrupted", align1, align2, len, ref, a);
+                break;
+            }
+        }
+    }
+
+    /* swapping a range with itself leaves it be */
+    memcpy(ref, a, len);
+    memswap_local(a, a, len);
+    if (memcmp(a, ref, len))
+        test_failed("memswap", "a with itself changed", align1, align1, len, ref, a);
+
+    free(base);
+    free(ref);
+    total_tests++;
+}
+
+static void run_rotate_test(size_t align, size_t n, size_t shift)
+{
+    const size_t guard = 64;
+    unsigned char *base = malloc(n + align + 2 * guard);
+    unsigned char *ref = malloc(n + 1);
+    unsigned char *buf = base + guard + align;
+
+    memset(base, 0xee, n + align + 2 * guard);
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (unsigned char)(i * 31 + (i >> 8) + 3);
+    for (size_t i = 0; i < n; i++)
+        ref[i] = buf[(i + shift % n) % n];
+
+    if (memrotate_local(buf, n, shift) != buf)
+        test_failed("memrotate", "wrong return value", align, shift, n, ref, buf);
+    else if (memcmp(buf, ref, n))
+        test_failed("memrotate", "content mismatch", align, shift, n, ref, buf);
+    else
+    {
+        for (unsigned char *p = base; p < base + n + align + 2 * guard; p++)
+        {
+            if ((p < buf || p >= buf + n) && *p != 0xee)
+            {
+                test_failed("memrotate", "guard corrupted", align, shift, n, ref, buf);
+                break;
+            }
+        }
+    }
+
+    free(base);
+    free(ref);
+    total_tests++;
+}
+
+static void test_rotate(void)
+{
+    printf("\ntesting memswap and memrotate...\n");
+    for (size_t len = 0; len <= 300; len++)
+    {
+        for (size_t align = 0; align < 64; align += 7)
+        {
+            run_swap_test(align, (align * 5) % 64, len, 0);
+            run_swap_test(align, (align * 5) % 64, len, 1 + align);
+        }
+    }
+
+    const size_t large_swaps[] = {4096, 4096 + 63, 65536 + 3, 1024 * 1024};
+    for (size_t i = 0; i < sizeof(large_swaps) / sizeof(large_swaps[0]); i++)
+    {
+        run_swap_test(0, 0, large_swaps[i], 0);
+        run_swap_test(3, 17, large_swaps[i], 4096);
+    }
+
+    /* every shift of the short ones, which take the stack path for one side or both */
+    for (size_t n = 0; n <= 600; n++)
+    {
+        for (size_t shift = 0; shift <= n + 1; shift += 1 + n / 40)
+            run_rotate_test(n % 64, n, shift);
+        run_rotate_test(0, n, n ? n - 1 : 0);
+        run_rotate_test(5, n, 3 * n + 1);
+    }
+
+    /* and enough block swaps, with both sides long, to get down to one of them short */
+    const size_t large[] = {1000, 4097, 65536 + 11, 1024 * 1024 + 7};
+    for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++)
+    {
+        const size_t n = large[i];
+        const size_t shifts[] = {1, 255, 256, 257, 300, 513, n / 3, n / 2, n / 2 + 1, n - 257, n - 256, n - 1};
+        for (size_t j = 0; j < sizeof(shifts) / sizeof(shifts[0]); j++)
+            run_rotate_test(j % 64, n, shifts[j]);
+    }
+}
+
+/* the same index tables on every run */
+static uint32_t next_random(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 33);
+}
+
+static int compare_indices(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+enum
+{
+    INDEX_RANDOM,
+    INDEX_SORTED,
+    INDEX_REPEATED
+};
+
+static int outside_untouched(const unsigned char *base, size_t span, const unsigned char *p, size_t n)
+{
+    for (const unsigned char *q = base; q < base + span; q++)
+    {
+        if ((q < p || q >= p + n) && *q != 0xee)
+            return 0;
+    }
+    return 1;
+}
+
+/* count records of size bytes gathered from a table of records of them into a packed dst, and
+ * scattered from a packed buffer back over a copy of the table, dst between guards each time;
+ * the indices are random, ascending, or only the first three records over and over */
+static void run_gather_test(size_t align, size_t size, size_t count, size_t records, int pattern)
+{
+    const size_t guard = 64;
+    const size_t most = (records > count ? records : count) * size;
+    const size_t span = most + align + 2 * guard;
+    uint32_t *idx = malloc((count + 1) * sizeof(*idx));
+    unsigned char *table = malloc(records * size);
+    unsigned char *packed = malloc(count * size + 1);
+    unsigned char *ref = malloc(most + 1);
+    unsigned char *base = malloc(span);
+    unsigned char *dst = base + guard + align;
+    uint64_t state = size * 1000003 + count * 31 + pattern;
+
+    for (size_t i = 0; i < count; i++)
+        idx[i] = next_random(&state) % (pattern == INDEX_REPEATED ? 3 : records);
+    if (pattern == INDEX_SORTED)
+        qsort(idx, count, sizeof(*idx), compare_indices);
+    for (size_t i = 0; i < records * size; i++)
+        table[i] = (unsigned char)(i * 7 + i / 251 + 1);
+    for (size_t i = 0; i < count * size; i++)
+        packed[i] = (unsigned char)(i * 13 + i / 241 + 0x80);
+
+    for (size_t i = 0; i < count; i++)
+        memcpy(ref + i * size, table + (size_t)idx[i] * size, size);
+    memset(base, 0xee, span);
+    if (memcpy_gather(dst, table, idx, count, size) != dst)
+        test_failed("memcpy_gather", "wrong return value", align, size, count * size, ref, dst);
+    else if (memcmp(dst, ref, count * size))
+        test_failed("memcpy_gather", "content mismatch", align, size, count * size, ref, dst);
+    else if (!outside_untouched(base, span, dst, count * size))
+        test_failed("memcpy_gather", "guard corrupted", align, size, count * size, ref, dst);
+
+    /* in index order, so the last of any repeats is the one left */
+    memcpy(ref, table, records * size);
+    for (size_t i = 0; i < count; i++)
+        memcpy(ref + (size_t)idx[i] * size, packed + i * size, size);
+    memset(base, 0xee, span);
+    memcpy(dst, table, records * size);
+    if (memcpy_scatter(dst, packed, idx, count, size) != dst)
+        test_failed("memcpy_scatter", "wrong return value", align, size, records * size, ref, dst);
+    else if (memcmp(dst, ref, records * size))
+        test_failed("memcpy_scatter", "content mismatch", align, size, records * size, ref, dst);
+    else if (!outside_untouched(base, span, dst, records * size))
+        test_failed("memcpy_scatter", "guard corrupted", align, size, records * size, ref, dst);
+
+    free(idx);
+    free(table);
+    free(packed);
+    free(ref);
+    free(base);
+    total_tests++;
+}
+
+#if SIZE_MAX > UINT32_MAX
+/* records more than 4 GiB into a table, which only the pages touched are ever backed for, to
+ * catch an index scaled in 32 bits */
+static void run_gather_far_test(size_t size)
+{
+    const size_t map_size = (size_t)1 << 33, count = 37;
+    uint32_t idx[37];
+    unsigned char packed[37 * 64], ref[37 * 64];
+    unsigned char *table = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+    if (table == MAP_FAILED)
+    {
+        printf("no room for an 8 GiB mapping, skipping the far %zu byte records.\n", size);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        idx[i] = (uint32_t)((map_size - page_size) / size - i * 4099);
+        for (size_t j = 0; j < size; j++)
+        {
+            table[(size_t)idx[i] * size + j] = (unsigned char)(i * 17 + j + 1);
+            packed[i * size + j] = (unsigned char)(i * 5 + j * 3 + 0x40);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+        memcpy(ref + i * size, table + (size_t)idx[i] * size, size);
+    memcpy_gather(packed, table, idx, count, size);
+    if (memcmp(packed, ref, count * size))
+        test_failed("memcpy_gather", "far records mismatch", 0, size, count * size, ref, packed);
+
+    for (size_t i = 0; i < count * size; i++)
+        packed[i] = (unsigned char)~ref[i];
+    memcpy_scatter(table, packed, idx, count, size);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (memcmp(table + (size_t)idx[i] * size, packed + i * size, size))
+        {
+            test_failed("memcpy_scatter", "far records mismatch", 0, size, size, packed + i * size,
+                        table + (size_t)idx[i] * size);
+            break;
+        }
+    }
+
+    munmap(table, map_size);
+    total_tests++;
+}
+#endif
+
+static void test_gather(void)
+{
+    printf("\ntesting memcpy_gather and memcpy_scatter...\n");
+    const size_t counts[] = {0, 1, 7, 9, 17, 40};
+    for (size_t size = 1; size <= 300; size++)
+    {
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+            run_gather_test(size % 64, size, counts[i], 24, (int)(i % 3));
+    }
+
+    /* every tail of the vector kernels, and past the prefetch distance */
+    const size_t vector_sizes[] = {8, 16};
+    for (size_t i = 0; i < sizeof(vector_sizes) / sizeof(vector_sizes[0]); i++)
+    {
+        for (size_t count = 0; count <= 70; count++)
+        {
+            for (int pattern = INDEX_RANDOM; pattern <= INDEX_REPEATED; pattern++)
+                run_gather_test(count % 64, vector_sizes[i], count, 100, pattern);
+        }
+    }
+
+    const size_t large_sizes[] = {8, 16, 24, 64, 100, 256, 1000, 4096};
+    for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++)
+    {
+        run_gather_test(3, large_sizes[i], 5000, 4096, INDEX_RANDOM);
+        run_gather_test(0, large_sizes[i], 5000, 4096, INDEX_SORTED);
+    }
+
+#if SIZE_MAX > UINT32_MAX
+    const size_t far_sizes[] = {8, 16, 48, 64};
+    for (size_t i = 0; i < sizeof(far_sizes) / sizeof(far_sizes[0]); i++)
+        run_gather_far_test(far_sizes[i]);
+#endif
+}
+
+static int current_hint;
+
+static void *hint_copy(void *dst, const void *src, size_t n)
+{
+    return memcpy_hint(dst, src, n, current_hint);
+}
+
+static void test_hints(void)
+{
+    static const struct
+    {
+        const char *name;
+        int flags;
+    } hints[] = {
+        {"memcpy_hint (none)", 0},
+        {"memcpy_hint (keep src)", MEMCPY_HINT_KEEP_SRC},
+        {"memcpy_hint (keep dst)", MEMCPY_HINT_KEEP_DST},
+        {"memcpy_hint (stream dst)", MEMCPY_HINT_STREAM_DST},
+        {"memcpy_hint (nta src)", MEMCPY_HINT_NTA_SRC},
+        {"memcpy_hint (nta src, stream dst)", MEMCPY_HINT_NTA_SRC | MEMCPY_HINT_STREAM_DST},
+        {"memcpy_hint (demote dst)", MEMCPY_HINT_DEMOTE_DST},
+        {"memcpy_hint (everything)", 0x1f},
+    };
+
+    for (size_t i = 0; i < sizeof(hints) / sizeof(hints[0]); i++)
+    {
+        current_hint = hints[i].flags;
+        test_operation(hints[i].name, hint_copy);
+    }
+}
+
+/* into fresh mappings, ending right before a PROT_NONE page, at every kind of chunk boundary */
+static void test_prefault(void)
+{
+    static const size_t sizes[] = {1, 4095, 4097, 256 * 1024 - 1, 256 * 1024 + 4097, 3 * 1024 * 1024 + 123};
+    static const size_t offsets[] = {0, 1, 4000, 256 * 1024 - 64};
+    const size_t max_len = 4 * 1024 * 1024;
+    unsigned char *src = malloc(max_len);
+
+    printf("\ntesting memcpy_prefault...\n");
+    test_operation("memcpy_prefault", memcpy_prefault);
+
+    for (size_t i = 0; i < max_len; i++)
+        src[i] = (unsigned char)(i * 31 + i / 4093);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); j++)
+        {
+            const size_t len = sizes[i], offset = offsets[j];
+            const size_t mapped = (offset + len + page_size - 1) / page_size * page_size;
+            unsigned char *map = mmap(NULL, mapped + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                      -1, 0);
+            if (map == MAP_FAILED)
+            {
+                fprintf(stderr, "failed to map prefault test buffer\n");
+                exit(1);
+            }
+            mprotect(map + mapped, page_size, PROT_NONE);
+
+            void *ret = memcpy_prefault(map + offset, src + j, len);
+            if (ret != map + offset)
+                test_failed("memcpy_prefault", "wrong return value", offset, j, len, src + j, map + offset);
+            else if (memcmp(map + offset, src + j, len))
+                test_failed("memcpy_prefault", "content mismatch", offset, j, len, src + j, map + offset);
+            else
+            {
+                for (size_t k = 0; k < mapped; k++)
+                {
+                    if ((k < offset || k >= offset + len) && map[k])
+                    {
+                        test_failed("memcpy_prefault", "wrote outside dst", offset, j, len, src + j, map + offset);
+                        break;
+                    }
+                }
+            }
+
+            munmap(map, mapped + page_size);
+            total_tests++;
+        }
+    }
+    free(src);
+}
+
+static void *async_copy(void *dst, const void *src, size_t n)
+{
+    memcpy_wait(memcpy_async(dst, src, n));
+    return dst;
+}
+
+/* a queue's worth and more of copies into one buffer, big ones through the copy thread and small
+ * ones that must not overtake them, replayed with memcpy into a reference; only the last is waited for */
+static void test_async_order(void)
+{
+    const size_t size = 1024 * 1024;
+    const size_t count = 1000;
+    unsigned char *src = malloc(size + 256);
+    unsigned char *dst = malloc(size);
+    unsigned char *expected = malloc(size);
+    memcpy_handle handle = 0;
+
+    for (size_t i = 0; i < size + 256; i++)
+        src[i] = (unsigned char)(i * 7 + i / 251);
+    memset(dst, 0, size);
+    memset(expected, 0, size);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t len = i % 3 ? (i * 97) % 4096 : size - (i * 4099) % size;
+        const size_t src_offset = i % 256;
+        const size_t dst_offset = (i * 8191) % (size - len + 1);
+        const memcpy_handle next = memcpy_async(dst + dst_offset, src + src_offset, len);
+
+        if (next < handle)
+        {
+            test_failed("memcpy_async", "handle went backwards", dst_offset, src_offset, len, expected, dst);
+            break;
+        }
+        handle = next;
+        memcpy(expected + dst_offset, src + src_offset, len);
+    }
+
+    memcpy_wait(handle);
+    if (!memcpy_test(handle) || !memcpy_test(0))
+        test_failed("memcpy_async", "waited for handle not done", 0, 0, size, expected, dst);
+    else if (memcmp(dst, expected, size))
+        test_failed("memcpy_async", "copies landed out of order", 0, 0, size, expected, dst);
+
+    free(src);
+    free(dst);
+    free(expected);
+    total_tests++;
+}
+
+#define ASYNC_PRODUCERS 4
+#define ASYNC_PRODUCER_SIZE (256 * 1024)
+
+/* queued copies, each waited for, until the shutdown has come and gone; a copy lost to it
+ * would leave its wait spinning */
+struct async_producer
+{
+    unsigned char *dst;
+    unsigned char *src[2];
+    int ok;
+};
+
+static int async_closed;
+
+static void *async_producer(void *arg)
+{
+    struct async_producer *p = arg;
+
+    for (int round = 0; round < 64 || !__atomic_load_n(&async_closed, __ATOMIC_ACQUIRE); round++)
+    {
+        memcpy_wait(memcpy_async(p->dst, p->src[round & 1], ASYNC_PRODUCER_SIZE));
+        if (memcmp(p->dst, p->src[round & 1], ASYNC_PRODUCER_SIZE))
+            p->ok = 0;
+    }
+    return NULL;
+}
+
+/* copies still queued when the copy thread is shut down are done by then, and the ones after
+ * it are done when memcpy_async() returns, also when other threads keep queueing through it */
+static void test_async_shutdown(void)
+{
+    const size_t size = 4 * 1024 * 1024;
+    unsigned char *src = malloc(size);
+    unsigned char *dst = malloc(size);
+    struct async_producer producers[ASYNC_PRODUCERS];
+    pthread_t threads[ASYNC_PRODUCERS];
+    int started = 0;
+
+    for (size_t i = 0; i < size; i++)
+        src[i] = (unsigned char)(i * 13 + i / 4093);
+    memset(dst, 0, size);
+
+    for (int i = 0; i < ASYNC_PRODUCERS; i++)
+    {
+        struct async_producer *p = &producers[i];
+        p->dst = malloc(ASYNC_PRODUCER_SIZE);
+        p->src[0] = malloc(ASYNC_PRODUCER_SIZE);
+        p->src[1] = malloc(ASYNC_PRODUCER_SIZE);
+        p->ok = 1;
+        for (size_t j = 0; j < ASYNC_PRODUCER_SIZE; j++)
+        {
+            p->src[0][j] = (unsigned char)(j + i);
+            p->src[1][j] = (unsigned char)(j * 3 + i);
+        }
+    }
+    while (started < ASYNC_PRODUCERS && !pthread_create(&threads[started], NULL, async_producer, &producers[started]))
+        started++;
+
+    const memcpy_handle queued = memcpy_async(dst, src, size / 2);
+    memcpy_async_shutdown();
+    __atomic_store_n(&async_closed, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (!producers[i].ok)
+            test_failed("memcpy_async_shutdown", "copy racing with it not done", 0, 0, ASYNC_PRODUCER_SIZE,
+                        producers[i].src[0], producers[i].dst);
+    }
+    for (int i = 0; i < ASYNC_PRODUCERS; i++)
+    {
+        free(producers[i].dst);
+        free(producers[i].src[0]);
+        free(producers[i].src[1]);
+    }
+
+    if (!memcpy_test(queued) || memcmp(dst, src, size / 2))
+        test_failed("memcpy_async_shutdown", "queued copy not done", 0, 0, size / 2, src, dst);
+
+    const memcpy_handle after = memcpy_async(dst + size / 2, src + size / 2, size / 2);
+    if (!memcpy_test(after) || memcmp(dst, src, size))
+        test_failed("memcpy_async_shutdown", "copy after it not done", 0, 0, size, src, dst);
+
+    free(src);
+    free(dst);
+    total_tests++;
+}
+
+static void *stats_thread(void *arg)
+{
+    unsigned char *buf = arg;
+
+    for (int i = 0; i < 3; i++)
+        memcpy_local(buf + 2048, buf, 1000);
+    return NULL;
+}
+
+/* calls from this thread and from one that has exited by the time of the snapshot both count */
+static void test_stats(void)
+{
+    struct membase_stats before, after;
+    unsigned char *buf = calloc(1, 4096);
+    pthread_t thread;
+
+    if (!membase_stats_snapshot(&before))
+    {
+        printf("\nnot a MEMBASE_STATS build, skipping the stats tests.\n");
+        free(buf);
+        return;
+    }
+    printf("\ntesting membase_stats_snapshot...\n");
+
+    memcpy_local(buf + 1024, buf, 100);
+    memmove_local(buf + 10, buf, 100);
+    memmove_local(buf, buf, 100);
+    if (pthread_create(&thread, NULL, stats_thread, buf) || pthread_join(thread, NULL))
+        stats_thread(buf);
+    membase_stats_snapshot(&after);
+
+    uint64_t tier_runs = 0;
+    for (int i = 0; i < MEMBASE_TIER_COUNT; i++)
+        tier_runs += after.tiers[i] - before.tiers[i];
+
+    /* 100 is 7 bits long, 1000 is 10 */
+    if (after.calls[7] - before.calls[7] != 3 || after.bytes[7] - before.bytes[7] != 300)
+        test_failed("membase_stats", "wrong count for 100 byte calls", 0, 0, 100, buf, buf);
+    else if (after.calls[10] - before.calls[10] != 3 || after.bytes[10] - before.bytes[10] != 3000)
+        test_failed("membase_stats", "calls from an exited thread lost", 0, 0, 1000, buf, buf);
+    else if (after.memmove_backward - before.memmove_backward != 1 || after.memmove_same - before.memmove_same != 1)
+        test_failed("membase_stats", "wrong memmove paths", 0, 0, 100, buf, buf);
+    else if (tier_runs != 5 || after.cached - before.cached != 5 || after.cached_bytes - before.cached_bytes != 3200)
+        test_failed("membase_stats", "wrong kernel runs", 0, 0, 0, buf, buf);
+
+    free(buf);
+    total_tests++;
+}
+
+static void test_alias_distances(const char *op, stringop_fn fn, int overlapping)
+{
+    printf("\ntesting %s 4k-aliasing distances...\n", op);
+
+    /* distances just past and just short of page multiples, around the aliasing window */
+    const ssize_t deltas[] = {1, 2, 15, 16, 63, 64, 255, 256, 257, 511, 4095};
+    const ssize_t lens[] = {511, 512, 513, 1000, 4096, 8191, 16384};
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        ssize_t len = lens[i];
+        /* smallest page multiple that keeps the buffers disjoint, or one that overlaps them */
+        ssize_t base = overlapping ? (len / 2) & ~(ssize_t)4095 : (len + 4095) & ~(ssize_t)4095;
+
+        for (size_t j = 0; j < sizeof(deltas) / sizeof(deltas[0]); j++)
+        {
+            ssize_t offsets[] = {base + deltas[j], base + 4096 - deltas[j]};
+            for (size_t k = 0; k < 2; k++)
+            {
+                ssize_t offset = offsets[k];
+                if ((offset < len) != overlapping || offset <= 0)
+                    continue;
+                run_overlap_test(op, offset, len, fn);
+                run_overlap_test(op, -offset, len, fn);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int failed_temp = 0;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    const char *test_type = (argc > 1) ? argv[1] : "all";
+
+    if (strcmp(test_type, "memcpy") == 0 || strcmp(test_type, "all") == 0)
+    {
+        test_operation("memcpy", memcpy_local);
+        test_alias_distances("memcpy", memcpy_local, 0);
+        test_profiled();
+        failed_temp = failed_tests;
+        if (!failed_temp)
+            printf("\nall memcpy tests passed.\n");
+    }
+
+    if (strcmp(test_type, "memmove") == 0 || strcmp(test_type, "all") == 0)
+    {
+        test_operation("memmove", memmove_local);
+        test_memmove_overlaps(memmove_local);
+        test_memmove_split(memmove_local);
+        test_alias_distances("memmove", memmove_local, 0);
+        test_alias_distances("memmove", memmove_local, 1);
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall memmove tests passed.\n");
+    }
+
+    if (strcmp(test_type, "memcpy2d") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_copy2d();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall memcpy2d tests passed.\n");
+    }
+
+    if (strcmp(test_type, "bswap") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_bswap();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall bswap tests passed.\n");
+    }
+
+    if (strcmp(test_type, "scan") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_scan();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall scan tests passed.\n");
+    }
+
+    if (strcmp(test_type, "pad") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_pad();
+        test_strcopy();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall pad and string copy tests passed.\n");
+    }
+
+    if (strcmp(test_type, "engines") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_engines();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall engine tests passed.\n");
+    }
+
+    if (strcmp(test_type, "persist") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_persist();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall persist tests passed.\n");
+    }
+
+    if (strcmp(test_type, "delta") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_delta();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall delta tests passed.\n");
+    }
+
+    if (strcmp(test_type, "sparse") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_sparse();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall sparse tests passed.\n");
+    }
+
+    if (strcmp(test_type, "rotate") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_rotate();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall swap and rotate tests passed.\n");
+    }
+
+    if (strcmp(test_type, "gather") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_gather();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall gather and scatter tests passed.\n");
+    }
+
+    if (strcmp(test_type, "hint") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_hints();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall hint tests passed.\n");
+    }
+
+    if (strcmp(test_type, "prefault") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_prefault();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall prefault tests passed.\n");
+    }
+
+    if (strcmp(test_type, "async") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        printf("\ntesting memcpy_async...\n");
+        test_operation("memcpy_async", async_copy);
+        test_async_order();
+        test_async_shutdown();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall async tests passed.\n");
+    }
+
+    if (strcmp(test_type, "stats") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+        test_stats();
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall stats tests passed.\n");
+    }
+
+    /* every dispatcher again through the 256-bit AVX-512VL tier */
+    if (strcmp(test_type, "policy") == 0 || strcmp(test_type, "all") == 0)
+    {
+        failed_temp = failed_tests;
+#ifdef FEAT_AVX512VL
+        if (cpu_supports(FEAT_AVX512VL))
+        {
+            const int previous = memop_avx512_policy(AVX512_POLICY_YMM);
+            printf("\ntesting with the ymm AVX-512 policy...\n");
+            test_operation("memcpy", memcpy_local);
+            test_operation("memmove", memmove_local);
+            test_memmove_overlaps(memmove_local);
+            test_memmove_split(memmove_local);
+            test_alias_distances("memmove", memmove_local, 1);
+            test_copy2d();
+            test_bswap();
+            test_scan();
+            test_pad();
+            test_strcopy();
+            test_persist();
+            test_delta();
+            test_sparse();
+            test_rotate();
+            test_gather();
+            test_hints();
+            memop_avx512_policy(previous);
+        }
+        else
+#endif
+            printf("\nno AVX-512VL, skipping the ymm AVX-512 policy tests.\n");
+        failed_temp = failed_tests - failed_temp;
+        if (!failed_temp)
+            printf("\nall policy tests passed.\n");
     }
 
     if (failed_tests == 0)